@@ -82,7 +82,7 @@ MODULE_API void dot_diffusion_dither(const DitherImage* img, const DotDiffusionM
             PHash_insert(lut, cmatrix->buffer[y * blocksize + x], Point_new(x, y));
 
     double* orig_img = (double*)calloc(img->width * img->height, sizeof(double));
-    memcpy(orig_img, img->buffer, img->width * img->height * sizeof(double));
+    DitherImage_to_doubles(img, orig_img);
 
     int pixel_no[9];
     double pixel_weight[9];
@@ -49,23 +49,29 @@ MODULE_API void ErrorDiffusionMatrix_free(ErrorDiffusionMatrix* self) {
     }
 }
 
-/* ***** ERROR DIFFUSION DITHER FUNCTION ***** */
+/* ***** INCREMENTAL ERROR DIFFUSION STATE ***** */
 
-MODULE_API void error_diffusion_dither(const DitherImage* img,
-                                       const ErrorDiffusionMatrix* m,
-                                       bool serpentine,
-                                       double sigma,
-                                       uint8_t* out) {
-    /* Error Diffusion dithering
-     * img: source image to be dithered
-     * serpentine:
-     * sigma: jitter
-     * setPixel: callback function to set a pixel
-     */
+struct Private_ErrorDiffusionState {
+    const DitherImage* img;
+    float* buffer;       // working copy of the image that receives the diffused error
+    float* m_weights;
+    int* m_offset_x;
+    int* m_offset_y;
+    int matrix_length;
+    float divisor;
+    bool serpentine;
+    double sigma;
+    int y;               // next row to dither
+};
+
+MODULE_API ErrorDiffusionState* ErrorDiffusionState_new(const DitherImage* img,
+                                                        const ErrorDiffusionMatrix* m,
+                                                        bool serpentine,
+                                                        double sigma) {
     // prepare the matrix...
     int i = 0;
     int j = 0;
-    double *m_weights = NULL;
+    float *m_weights = NULL;
     int *m_offset_x = NULL;
     int *m_offset_y = NULL;
     int matrix_length = 0;
@@ -74,12 +80,12 @@ MODULE_API void error_diffusion_dither(const DitherImage* img,
             int value = m->buffer[y * m->width + x];
             if(value == -1) {
                 matrix_length = (m->width * m->height - i - 1);
-                m_weights = calloc((size_t)matrix_length * 2, sizeof(double ));
+                m_weights = calloc((size_t)matrix_length * 2, sizeof(float));
                 m_offset_x = calloc((size_t)matrix_length * 2, sizeof(int));
                 m_offset_y = calloc((size_t)matrix_length, sizeof(int));
             } else if(value > 0) {
-                m_weights[j] = (double)value;
-                m_weights[j + matrix_length] = (double)value;
+                m_weights[j] = (float)value;
+                m_weights[j + matrix_length] = (float)value;
                 m_offset_x[j] = (x - i);
                 m_offset_x[j + matrix_length] = -(x - i);
                 m_offset_y[j] = y;
@@ -89,15 +95,54 @@ MODULE_API void error_diffusion_dither(const DitherImage* img,
             }
         }
     }
-    // do the error diffusion...
-    double* buffer = calloc((size_t)(img->width * img->height), sizeof(double));
-    memcpy(buffer,img->buffer, (size_t)(img->width * img->height) * sizeof(double));
-    int direction = 0; // FORWARD
+    ErrorDiffusionState* self = calloc(1, sizeof(ErrorDiffusionState));
+    self->img = img;
+    self->buffer = calloc((size_t)(img->width * img->height), sizeof(float));
+    memcpy(self->buffer, img->buffer, (size_t)(img->width * img->height) * sizeof(float));
+    self->m_weights = m_weights;
+    self->m_offset_x = m_offset_x;
+    self->m_offset_y = m_offset_y;
+    self->matrix_length = matrix_length;
+    self->divisor = (float)m->divisor;
+    self->serpentine = serpentine;
+    self->sigma = sigma;
+    self->y = 0;
+    return self;
+}
+
+MODULE_API void ErrorDiffusionState_free(ErrorDiffusionState* self) {
+    if(self) {
+        free(self->buffer);
+        free(self->m_weights);
+        free(self->m_offset_x);
+        free(self->m_offset_y);
+        free(self);
+        self = NULL;
+    }
+}
+
+/* ***** ERROR DIFFUSION DITHER FUNCTION ***** */
+
+MODULE_API int error_diffusion_dither_rows(ErrorDiffusionState* state, int rows, uint8_t* out) {
+    /* Dithers the next 'rows' rows of the state's image
+     * out: output buffer for the whole image; only the dithered rows are written
+     * returns the number of rows dithered, 0 once the image is complete
+     */
+    const DitherImage* img = state->img;
+    float* buffer = state->buffer;
+    const float* m_weights = state->m_weights;
+    const int* m_offset_x = state->m_offset_x;
+    const int* m_offset_y = state->m_offset_y;
+    int matrix_length = state->matrix_length;
     int direction_toggle = 1;
-    if(serpentine) direction_toggle = 2;
+    if(state->serpentine) direction_toggle = 2;
 
-    double threshold = 0.5;
-    for(int y = 0; y < img->height; y++) {
+    int y_start = state->y;
+    int y_end = y_start + rows;
+    if(y_end > img->height) y_end = img->height;
+    int direction = y_start % direction_toggle; // FORWARD on even rows
+    float threshold = 0.5f;
+    for(int y = y_start; y < y_end; y++) {
         int start, end, step;
         if(direction == 0) {
             start = 0;
@@ -110,14 +155,14 @@ MODULE_API void error_diffusion_dither(const DitherImage* img,
         }
         for (int x = start; x != end; x += step) {
             size_t addr = y * img->width + x;
-            double err = buffer[addr];
-            if(sigma > 0.0)
-                threshold = box_muller(sigma, 0.5);
+            float err = buffer[addr];
+            if(state->sigma > 0.0)
+                threshold = (float)box_muller(state->sigma, 0.5);
             if(err > threshold) {
                 out[addr] = 0xff;
-                err -= 1.0;
+                err -= 1.0f;
             }
-            err /= m->divisor;
+            err /= state->divisor;
             for(int g = 0; g < matrix_length; g++) {
                 int xx = x + m_offset_x[g + matrix_length * direction];
                 if(-1 < xx && xx < img->width) {
@@ -130,8 +175,22 @@ MODULE_API void error_diffusion_dither(const DitherImage* img,
         }
         direction = (y + 1) % direction_toggle;
     }
-    free(buffer);
-    free(m_weights);
-    free(m_offset_x);
-    free(m_offset_y);
+    state->y = y_end;
+    return y_end - y_start;
+}
+
+MODULE_API void error_diffusion_dither(const DitherImage* img,
+                                       const ErrorDiffusionMatrix* m,
+                                       bool serpentine,
+                                       double sigma,
+                                       uint8_t* out) {
+    /* Error Diffusion dithering
+     * img: source image to be dithered
+     * serpentine:
+     * sigma: jitter
+     * setPixel: callback function to set a pixel
+     */
+    ErrorDiffusionState* state = ErrorDiffusionState_new(img, m, serpentine, sigma);
+    error_diffusion_dither_rows(state, img->height, out);
+    ErrorDiffusionState_free(state);
 }
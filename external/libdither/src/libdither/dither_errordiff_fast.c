@@ -0,0 +1,404 @@
+#define MODULE_API_EXPORTS
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libdither.h"
+
+#if !defined(_MSC_VER) && !defined(__STDC_NO_ATOMICS__)
+#define ED_PARALLEL
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#endif
+
+/*
+ * Fixed-point error diffusion.
+ * Pixels and errors are int32 in Q12 (1.0 = 4096), the matrix weights are divided by the divisor once
+ * and kept in Q16. The error is kept in a ring of matrix-height rows that is padded on both sides, so
+ * no tap needs a bounds check. Built-in matrices get kernels with their taps unrolled at compile time,
+ * any other matrix runs through the generic kernel, which gives the same results.
+ *
+ * With more than one thread, rows are dithered as a wavefront: each row trails the one above by enough columns
+ * that it only reads finished pixels and never writes where the row above still writes. The error is summed in
+ * integers, so the order in which rows add it does not matter and the output equals the serial one.
+ */
+
+#define ED_ONE (1 << 12)
+#define ED_MAX_KERNEL_ROWS 4
+/* weight w / divisor d in Q16, rounded */
+#define ED_WEIGHT(w, d) ((int32_t)(((w) * 65536 + (d) / 2) / (d)))
+/* diffuses the error to the pixel dx columns ahead of x in row r, mirrored on backward rows */
+#define ED_TAP(r, dx, w) (r)[x + ed_dir * (dx)] += (e * ED_WEIGHT(w, ed_divisor) + 32768) >> 16;
+
+/* dithers columns begin up to (excluding) end of a row */
+typedef void (*ErrorDiffusionKernel)(int32_t* const* rows, const float* src, int begin, int end, uint8_t* out);
+
+#define ED_KERNEL_DIR(name, dir, divisor, taps) \
+static void name(int32_t* const* rows, const float* src, int begin, int end, uint8_t* out) { \
+    enum { ed_dir = dir, ed_divisor = divisor }; \
+    int32_t* r0 = rows[0]; \
+    int32_t* r1 = rows[1]; \
+    int32_t* r2 = rows[2]; \
+    int32_t* r3 = rows[3]; \
+    (void)r1; (void)r2; (void)r3; \
+    for(int x = begin; x != end; x += ed_dir) { \
+        int32_t e = (int32_t)(src[x] * ED_ONE + 0.5f) + r0[x]; \
+        if(e > ED_ONE / 2) { \
+            out[x] = 0xff; \
+            e -= ED_ONE; \
+        } else { \
+            out[x] = 0x00; \
+        } \
+        taps \
+    } \
+}
+/* defines name_fwd and name_bwd for left-to-right and right-to-left rows */
+#define ED_KERNEL(name, divisor, taps) \
+    ED_KERNEL_DIR(name##_fwd, 1, divisor, taps) \
+    ED_KERNEL_DIR(name##_bwd, -1, divisor, taps)
+
+/* ***** KERNELS FOR THE BUILT-IN MATRICES ***** */
+
+ED_KERNEL(kernel_diagonal, 16,
+          ED_TAP(r0, 1, 5)
+          ED_TAP(r1, -1, 2) ED_TAP(r1, 0, 3) ED_TAP(r1, 1, 6))
+ED_KERNEL(kernel_floyd_steinberg, 16,
+          ED_TAP(r0, 1, 7)
+          ED_TAP(r1, -1, 3) ED_TAP(r1, 0, 5) ED_TAP(r1, 1, 1))
+ED_KERNEL(kernel_shiaufan_3, 8,
+          ED_TAP(r0, 1, 4)
+          ED_TAP(r1, -2, 1) ED_TAP(r1, -1, 1) ED_TAP(r1, 0, 2))
+ED_KERNEL(kernel_shiaufan_2, 16,
+          ED_TAP(r0, 1, 7)
+          ED_TAP(r1, -2, 1) ED_TAP(r1, -1, 3) ED_TAP(r1, 0, 5))
+ED_KERNEL(kernel_shiaufan_1, 16,
+          ED_TAP(r0, 1, 8)
+          ED_TAP(r1, -3, 1) ED_TAP(r1, -2, 1) ED_TAP(r1, -1, 2) ED_TAP(r1, 0, 4))
+ED_KERNEL(kernel_stucki, 42,
+          ED_TAP(r0, 1, 8) ED_TAP(r0, 2, 4)
+          ED_TAP(r1, -2, 2) ED_TAP(r1, -1, 4) ED_TAP(r1, 0, 8) ED_TAP(r1, 1, 4) ED_TAP(r1, 2, 2)
+          ED_TAP(r2, -2, 1) ED_TAP(r2, -1, 2) ED_TAP(r2, 0, 4) ED_TAP(r2, 1, 2) ED_TAP(r2, 2, 1))
+ED_KERNEL(kernel_diffusion_1d, 1,
+          ED_TAP(r0, 1, 1))
+ED_KERNEL(kernel_diffusion_2d, 2,
+          ED_TAP(r0, 1, 1)
+          ED_TAP(r1, 0, 1))
+ED_KERNEL(kernel_fake_floyd_steinberg, 8,
+          ED_TAP(r0, 1, 3)
+          ED_TAP(r1, 0, 3) ED_TAP(r1, 1, 2))
+ED_KERNEL(kernel_jarvis_judice_ninke, 48,
+          ED_TAP(r0, 1, 7) ED_TAP(r0, 2, 5)
+          ED_TAP(r1, -2, 3) ED_TAP(r1, -1, 5) ED_TAP(r1, 0, 7) ED_TAP(r1, 1, 5) ED_TAP(r1, 2, 3)
+          ED_TAP(r2, -2, 1) ED_TAP(r2, -1, 3) ED_TAP(r2, 0, 5) ED_TAP(r2, 1, 3) ED_TAP(r2, 2, 1))
+ED_KERNEL(kernel_atkinson, 8,
+          ED_TAP(r0, 1, 1) ED_TAP(r0, 2, 1)
+          ED_TAP(r1, -1, 1) ED_TAP(r1, 0, 1) ED_TAP(r1, 1, 1)
+          ED_TAP(r2, 0, 1))
+ED_KERNEL(kernel_burkes, 32,
+          ED_TAP(r0, 1, 8) ED_TAP(r0, 2, 4)
+          ED_TAP(r1, -2, 2) ED_TAP(r1, -1, 4) ED_TAP(r1, 0, 8) ED_TAP(r1, 1, 4) ED_TAP(r1, 2, 2))
+ED_KERNEL(kernel_sierra_3, 32,
+          ED_TAP(r0, 1, 5) ED_TAP(r0, 2, 3)
+          ED_TAP(r1, -2, 2) ED_TAP(r1, -1, 4) ED_TAP(r1, 0, 5) ED_TAP(r1, 1, 4) ED_TAP(r1, 2, 2)
+          ED_TAP(r2, -1, 2) ED_TAP(r2, 0, 3) ED_TAP(r2, 1, 2))
+ED_KERNEL(kernel_sierra_2row, 16,
+          ED_TAP(r0, 1, 4) ED_TAP(r0, 2, 3)
+          ED_TAP(r1, -2, 1) ED_TAP(r1, -1, 2) ED_TAP(r1, 0, 3) ED_TAP(r1, 1, 2) ED_TAP(r1, 2, 1))
+ED_KERNEL(kernel_sierra_lite, 4,
+          ED_TAP(r0, 1, 2)
+          ED_TAP(r1, -1, 1) ED_TAP(r1, 0, 1))
+ED_KERNEL(kernel_steve_pigeon, 14,
+          ED_TAP(r0, 1, 2) ED_TAP(r0, 2, 1)
+          ED_TAP(r1, -1, 2) ED_TAP(r1, 0, 2) ED_TAP(r1, 1, 2)
+          ED_TAP(r2, -2, 1) ED_TAP(r2, 0, 1) ED_TAP(r2, 2, 1))
+ED_KERNEL(kernel_robert_kist, 220,
+          ED_TAP(r0, 1, 90)
+          ED_TAP(r1, -2, 10) ED_TAP(r1, -1, 20) ED_TAP(r1, 0, 30) ED_TAP(r1, 1, 20) ED_TAP(r1, 2, 10)
+          ED_TAP(r2, -2, 10) ED_TAP(r2, -1, 5) ED_TAP(r2, 0, 10) ED_TAP(r2, 1, 5) ED_TAP(r2, 2, 10))
+ED_KERNEL(kernel_stevenson_arce, 200,
+          ED_TAP(r0, 1, 32)
+          ED_TAP(r1, -3, 6) ED_TAP(r1, -2, 13) ED_TAP(r1, -1, 10) ED_TAP(r1, 0, 19) ED_TAP(r1, 1, 10) ED_TAP(r1, 2, 18) ED_TAP(r1, 3, 8)
+          ED_TAP(r2, -1, 12) ED_TAP(r2, 0, 26) ED_TAP(r2, 1, 12)
+          ED_TAP(r3, -3, 3) ED_TAP(r3, -2, 6) ED_TAP(r3, -1, 4) ED_TAP(r3, 0, 8) ED_TAP(r3, 1, 4) ED_TAP(r3, 2, 7) ED_TAP(r3, 3, 2))
+
+static const struct {
+    ErrorDiffusionMatrix* (*get_matrix)(void);
+    ErrorDiffusionKernel forward;
+    ErrorDiffusionKernel backward;
+} builtin_kernels[] = {
+    {get_diagonal_matrix, kernel_diagonal_fwd, kernel_diagonal_bwd},
+    {get_floyd_steinberg_matrix, kernel_floyd_steinberg_fwd, kernel_floyd_steinberg_bwd},
+    {get_shiaufan3_matrix, kernel_shiaufan_3_fwd, kernel_shiaufan_3_bwd},
+    {get_shiaufan2_matrix, kernel_shiaufan_2_fwd, kernel_shiaufan_2_bwd},
+    {get_shiaufan1_matrix, kernel_shiaufan_1_fwd, kernel_shiaufan_1_bwd},
+    {get_stucki_matrix, kernel_stucki_fwd, kernel_stucki_bwd},
+    {get_diffusion_1d_matrix, kernel_diffusion_1d_fwd, kernel_diffusion_1d_bwd},
+    {get_diffusion_2d_matrix, kernel_diffusion_2d_fwd, kernel_diffusion_2d_bwd},
+    {get_fake_floyd_steinberg_matrix, kernel_fake_floyd_steinberg_fwd, kernel_fake_floyd_steinberg_bwd},
+    {get_jarvis_judice_ninke_matrix, kernel_jarvis_judice_ninke_fwd, kernel_jarvis_judice_ninke_bwd},
+    {get_atkinson_matrix, kernel_atkinson_fwd, kernel_atkinson_bwd},
+    {get_burkes_matrix, kernel_burkes_fwd, kernel_burkes_bwd},
+    {get_sierra_3_matrix, kernel_sierra_3_fwd, kernel_sierra_3_bwd},
+    {get_sierra_2row_matrix, kernel_sierra_2row_fwd, kernel_sierra_2row_bwd},
+    {get_sierra_lite_matrix, kernel_sierra_lite_fwd, kernel_sierra_lite_bwd},
+    {get_steve_pigeon_matrix, kernel_steve_pigeon_fwd, kernel_steve_pigeon_bwd},
+    {get_robert_kist_matrix, kernel_robert_kist_fwd, kernel_robert_kist_bwd},
+    {get_stevenson_arce_matrix, kernel_stevenson_arce_fwd, kernel_stevenson_arce_bwd},
+};
+
+/* ***** FAST ERROR DIFFUSION STATE ***** */
+
+struct Private_FastErrorDiffusionState {
+    const DitherImage* img;
+    ErrorDiffusionKernel forward;   // NULL if the generic kernel is used
+    ErrorDiffusionKernel backward;
+    int* tap_dx;
+    int* tap_dy;
+    int32_t* tap_weight;            // Q16
+    int tap_count;
+    int32_t* ring;                  // error rows, row y lives at (y % ring_rows)
+    int32_t** rows;                 // the ring rows in order for the current image row
+    int matrix_rows;
+    int ring_rows;                  // matrix_rows + threads
+    int threads;
+    int lag;                        // columns a row trails the row above in the wavefront
+    int pad;                        // columns of padding on either side of a ring row
+    int stride;
+    bool serpentine;
+    int y;                          // next row to dither
+};
+
+static bool matrix_equals(const ErrorDiffusionMatrix* a, const ErrorDiffusionMatrix* b) {
+    return a->width == b->width && a->height == b->height && a->divisor == b->divisor
+        && memcmp(a->buffer, b->buffer, (size_t)(a->width * a->height) * sizeof(int)) == 0;
+}
+
+MODULE_API FastErrorDiffusionState* FastErrorDiffusionState_new(const DitherImage* img,
+                                                                const ErrorDiffusionMatrix* m,
+                                                                bool serpentine) {
+    FastErrorDiffusionState* self = calloc(1, sizeof(FastErrorDiffusionState));
+    self->img = img;
+    self->serpentine = serpentine;
+    // collect the taps right of and below the current pixel (-1 in the matrix)
+    int cells = m->width * m->height;
+    self->tap_dx = calloc((size_t)cells, sizeof(int));
+    self->tap_dy = calloc((size_t)cells, sizeof(int));
+    self->tap_weight = calloc((size_t)cells, sizeof(int32_t));
+    int anchor = -1;
+    for(int i = 0; i < cells; i++) {
+        int value = m->buffer[i];
+        if(value == -1) {
+            anchor = i;
+        } else if(anchor != -1 && value > 0) {
+            int dx = i % m->width - anchor % m->width;
+            self->tap_dx[self->tap_count] = dx;
+            self->tap_dy[self->tap_count] = i / m->width;
+            self->tap_weight[self->tap_count] = (int32_t)(value * 65536.0 / m->divisor + 0.5);
+            self->tap_count++;
+            if(abs(dx) > self->pad) self->pad = abs(dx);
+        }
+    }
+    self->matrix_rows = m->height;
+    self->threads = 1;
+    self->ring_rows = self->matrix_rows + self->threads;
+    self->lag = 2 * self->pad + 1;
+    self->stride = img->width + 2 * self->pad;
+    self->ring = calloc((size_t)(self->ring_rows * self->stride), sizeof(int32_t));
+    self->rows = calloc((size_t)(self->matrix_rows > ED_MAX_KERNEL_ROWS ? self->matrix_rows : ED_MAX_KERNEL_ROWS), sizeof(int32_t*));
+
+    if(m->height <= ED_MAX_KERNEL_ROWS) {
+        for(size_t i = 0; i < sizeof(builtin_kernels) / sizeof(builtin_kernels[0]); i++) {
+            ErrorDiffusionMatrix* builtin = builtin_kernels[i].get_matrix();
+            bool match = matrix_equals(m, builtin);
+            ErrorDiffusionMatrix_free(builtin);
+            if(match) {
+                self->forward = builtin_kernels[i].forward;
+                self->backward = builtin_kernels[i].backward;
+                break;
+            }
+        }
+    }
+    return self;
+}
+
+MODULE_API void FastErrorDiffusionState_free(FastErrorDiffusionState* self) {
+    if(self) {
+        free(self->tap_dx);
+        free(self->tap_dy);
+        free(self->tap_weight);
+        free(self->ring);
+        free(self->rows);
+        free(self);
+        self = NULL;
+    }
+}
+
+MODULE_API int FastErrorDiffusionState_set_threads(FastErrorDiffusionState* self, int threads) {
+#ifdef ED_PARALLEL
+    // serpentine rows run in opposite directions and can't trail each other
+    if(self->y == 0 && !self->serpentine && threads > 1 && threads != self->threads) {
+        self->threads = threads;
+        self->ring_rows = self->matrix_rows + threads;
+        free(self->ring);
+        self->ring = calloc((size_t)(self->ring_rows * self->stride), sizeof(int32_t));
+    }
+#else
+    (void)threads;
+#endif
+    return self->threads;
+}
+
+/* ***** FAST ERROR DIFFUSION DITHER FUNCTION ***** */
+
+static void generic_kernel(const FastErrorDiffusionState* state, int32_t* const* rows, const float* src,
+                           int begin, int end, int dir, uint8_t* out) {
+    for(int x = begin; x != end; x += dir) {
+        int32_t e = (int32_t)(src[x] * ED_ONE + 0.5f) + rows[0][x];
+        if(e > ED_ONE / 2) {
+            out[x] = 0xff;
+            e -= ED_ONE;
+        } else {
+            out[x] = 0x00;
+        }
+        for(int t = 0; t < state->tap_count; t++) {
+            rows[state->tap_dy[t]][x + dir * state->tap_dx[t]] += (e * state->tap_weight[t] + 32768) >> 16;
+        }
+    }
+}
+
+static void set_ring_rows(const FastErrorDiffusionState* state, int y, int32_t** rows) {
+    for(int r = 0; r < state->matrix_rows; r++) {
+        rows[r] = state->ring + (size_t)((y + r) % state->ring_rows) * (size_t)state->stride + state->pad;
+    }
+}
+
+static void dither_span(const FastErrorDiffusionState* state, int32_t* const* rows, int y, int begin, int end,
+                        bool backward, uint8_t* out) {
+    /* forward spans are [begin, end), backward spans run from end - 1 down to begin */
+    const float* src = state->img->buffer + (size_t)y * (size_t)state->img->width;
+    uint8_t* dst = out + (size_t)y * (size_t)state->img->width;
+    if(state->forward) {
+        if(backward)
+            state->backward(rows, src, end - 1, begin - 1, dst);
+        else
+            state->forward(rows, src, begin, end, dst);
+    } else {
+        if(backward)
+            generic_kernel(state, rows, src, end - 1, begin - 1, -1, dst);
+        else
+            generic_kernel(state, rows, src, begin, end, 1, dst);
+    }
+}
+
+static void clear_ring_row(const FastErrorDiffusionState* state, int32_t* row) {
+    // this row's error has been consumed, it becomes row y + ring_rows
+    memset(row - state->pad, 0, (size_t)state->stride * sizeof(int32_t));
+}
+
+#ifdef ED_PARALLEL
+#define ED_CHUNK 32
+
+typedef struct {
+    FastErrorDiffusionState* state;
+    atomic_int next_row;    // next row of the batch to be claimed
+    atomic_int* progress;   // columns finished in each row of the batch
+    int y_start;
+    int y_end;
+    uint8_t* out;
+} Wavefront;
+
+static void wait_progress(const atomic_int* progress, int needed) {
+    int spins = 0;
+    while(atomic_load_explicit(progress, memory_order_acquire) < needed) {
+        if(++spins > 64) sched_yield();
+    }
+}
+
+static void* wavefront_worker(void* arg) {
+    Wavefront* wave = arg;
+    const FastErrorDiffusionState* state = wave->state;
+    int width = state->img->width;
+    int32_t** rows = calloc((size_t)(state->matrix_rows > ED_MAX_KERNEL_ROWS ? state->matrix_rows : ED_MAX_KERNEL_ROWS),
+                            sizeof(int32_t*));
+    int y;
+    while((y = atomic_fetch_add(&wave->next_row, 1) + wave->y_start) < wave->y_end) {
+        int i = y - wave->y_start;
+        // the ring row this row's taps reach last was cleared by row (y + matrix_rows - 1 - ring_rows)
+        int reused = i + state->matrix_rows - 1 - state->ring_rows;
+        if(reused >= 0) wait_progress(&wave->progress[reused], width);
+        set_ring_rows(state, y, rows);
+        for(int x = 0; x < width; x += ED_CHUNK) {
+            int x_end = x + ED_CHUNK < width ? x + ED_CHUNK : width;
+            if(i > 0) {
+                int needed = x_end - 1 + state->lag;
+                wait_progress(&wave->progress[i - 1], needed < width ? needed : width);
+            }
+            dither_span(state, rows, y, x, x_end, false, wave->out);
+            if(x_end == width) clear_ring_row(state, rows[0]);
+            atomic_store_explicit(&wave->progress[i], x_end, memory_order_release);
+        }
+    }
+    free(rows);
+    return NULL;
+}
+
+static void wavefront_dither_rows(FastErrorDiffusionState* state, int y_start, int y_end, uint8_t* out) {
+    Wavefront wave;
+    wave.state = state;
+    wave.y_start = y_start;
+    wave.y_end = y_end;
+    wave.out = out;
+    atomic_init(&wave.next_row, 0);
+    wave.progress = malloc((size_t)(y_end - y_start) * sizeof(atomic_int));
+    for(int i = 0; i < y_end - y_start; i++) atomic_init(&wave.progress[i], 0);
+    // rows are claimed in order, so any number of started helpers finishes the batch
+    int helpers = state->threads - 1;
+    if(helpers > y_end - y_start - 1) helpers = y_end - y_start - 1;
+    pthread_t* threads = calloc((size_t)(helpers > 0 ? helpers : 1), sizeof(pthread_t));
+    int started = 0;
+    for(int t = 0; t < helpers; t++) {
+        if(pthread_create(&threads[t], NULL, wavefront_worker, &wave) != 0) break;
+        started++;
+    }
+    wavefront_worker(&wave);
+    for(int t = 0; t < started; t++) pthread_join(threads[t], NULL);
+    free(threads);
+    free(wave.progress);
+}
+#endif
+
+MODULE_API int fast_error_diffusion_dither_rows(FastErrorDiffusionState* state, int rows, uint8_t* out) {
+    /* Dithers the next 'rows' rows of the state's image
+     * out: output buffer for the whole image; only the dithered rows are written
+     * returns the number of rows dithered, 0 once the image is complete
+     */
+    const DitherImage* img = state->img;
+    int y_start = state->y;
+    int y_end = y_start + rows;
+    if(y_end > img->height) y_end = img->height;
+#ifdef ED_PARALLEL
+    if(state->threads > 1 && y_end - y_start > 1) {
+        wavefront_dither_rows(state, y_start, y_end, out);
+        state->y = y_end;
+        return y_end - y_start;
+    }
+#endif
+    for(int y = y_start; y < y_end; y++) {
+        set_ring_rows(state, y, state->rows);
+        dither_span(state, state->rows, y, 0, img->width, state->serpentine && (y % 2 == 1), out);
+        clear_ring_row(state, state->rows[0]);
+    }
+    state->y = y_end;
+    return y_end - y_start;
+}
+
+MODULE_API void fast_error_diffusion_dither(const DitherImage* img,
+                                            const ErrorDiffusionMatrix* m,
+                                            bool serpentine,
+                                            uint8_t* out) {
+    FastErrorDiffusionState* state = FastErrorDiffusionState_new(img, m, serpentine);
+    fast_error_diffusion_dither_rows(state, img->height, out);
+    FastErrorDiffusionState_free(state);
+}
@@ -71,7 +71,7 @@ MODULE_API OrderedDitherMatrix* get_matrix_from_image(const DitherImage* img) {
     for(int y = 0; y < img->height; y++) {
         for (int x = 0; x < img->width; x++) {
             size_t addr = y * img->width + x;
-            matrix[addr] = (int)round(img->buffer[addr] * INT_MAX);
+            matrix[addr] = (int)round((double)img->buffer[addr] * INT_MAX);
         }
     }
     OrderedDitherMatrix* m = OrderedDitherMatrix_new(img->width, img->height, INT_MAX, matrix);
@@ -23,7 +23,7 @@ MODULE_API void variable_error_diffusion_dither(const DitherImage* img, enum Var
     } else {  // zhoufang
         coefs = zhoufang_coef;
         divs = zhoufang_divs;
-        memcpy(buffer, img->buffer, img->width * img->height * sizeof(double));
+        DitherImage_to_doubles(img, buffer);
     }
     // serpentine direction setup
     int direction = 0; // FORWARD
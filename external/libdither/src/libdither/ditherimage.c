@@ -1,7 +1,10 @@
 #define MODULE_API_EXPORTS
 #include <stdlib.h>
 #include <stdio.h>
+#include <stddef.h>
+#include <math.h>
 #include "libdither.h"
+#include "gamma.h"
 
 /*
  * DitherImage is a greyscale buffer in linear color space.
@@ -12,7 +15,7 @@ MODULE_API DitherImage* DitherImage_new(int width, int height) {
     DitherImage* self = calloc(1, sizeof(DitherImage));
     self->width = width;
     self->height = height;
-    self->buffer = calloc((size_t)(width * height), sizeof(double));
+    self->buffer = calloc((size_t)(width * height), sizeof(float));
     return self;
 }
 
@@ -40,7 +43,7 @@ MODULE_API void DitherImage_set_pixel(DitherImage* self, int x, int y, int r, in
             db = b / 255.0;
         }
         // weigh RGB values based on human perception to create final greyscale value
-        self->buffer[y * self->width + x] = dr * 0.299 + dg * 0.586 + db * 0.114;
+        self->buffer[y * self->width + x] = (float)(dr * 0.299 + dg * 0.586 + db * 0.114);
     }
 }
 
@@ -50,3 +53,221 @@ MODULE_API double DitherImage_get_pixel(DitherImage* self, int x, int y) {
         return self->buffer[y * self->width + x];
     return 0.0;
 }
+
+MODULE_API DitherImage* DitherImage_from_doubles(const double* values, int width, int height) {
+    DitherImage* self = DitherImage_new(width, height);
+    for(size_t i = 0; i < (size_t)(width * height); i++)
+        self->buffer[i] = (float)values[i];
+    return self;
+}
+
+MODULE_API void DitherImage_to_doubles(const DitherImage* self, double* out) {
+    for(size_t i = 0; i < (size_t)(self->width * self->height); i++)
+        out[i] = self->buffer[i];
+}
+
+static void pixel_layout(enum DitherPixelFormat format, int* r_offset, int* g_offset, int* b_offset, int* bpp) {
+    *r_offset = 0; *g_offset = 1; *b_offset = 2; *bpp = 4;
+    switch(format) {
+        case DITHER_PIXEL_RGBA32: break;
+        case DITHER_PIXEL_BGRA32: *r_offset = 2; *b_offset = 0; break;
+        case DITHER_PIXEL_ARGB32: *r_offset = 1; *g_offset = 2; *b_offset = 3; break;
+        case DITHER_PIXEL_ABGR32: *r_offset = 3; *g_offset = 2; *b_offset = 1; break;
+        case DITHER_PIXEL_RGB24: *bpp = 3; break;
+        case DITHER_PIXEL_BGR24: *r_offset = 2; *b_offset = 0; *bpp = 3; break;
+        case DITHER_PIXEL_GRAY8: *r_offset = 0; *g_offset = 0; *b_offset = 0; *bpp = 1; break;
+    }
+}
+
+/* source pixels and weights that make up each output pixel along one axis */
+typedef struct {
+    int* first;
+    int* count;
+    double* weights;  // max_taps weights per output pixel
+    int max_taps;
+} ResampleTable;
+
+static void ResampleTable_init(ResampleTable* self, int src_size, int dst_size) {
+    /* area averaging when shrinking, bilinear interpolation when enlarging */
+    double scale = (double)src_size / dst_size;
+    self->max_taps = scale > 1.0 ? (int)ceil(scale) + 1 : 2;
+    self->first = calloc((size_t)dst_size, sizeof(int));
+    self->count = calloc((size_t)dst_size, sizeof(int));
+    self->weights = calloc((size_t)(dst_size * self->max_taps), sizeof(double));
+    for(int i = 0; i < dst_size; i++) {
+        double* w = self->weights + i * self->max_taps;
+        int first, count;
+        if(src_size == dst_size) {
+            first = i;
+            count = 1;
+            w[0] = 1.0;
+        } else if(scale > 1.0) {
+            double start = i * scale;
+            double end = start + scale;
+            first = (int)start;
+            int last = (int)ceil(end) - 1;
+            if(last >= src_size) last = src_size - 1;
+            count = last - first + 1;
+            if(count > self->max_taps) count = self->max_taps;
+            for(int t = 0; t < count; t++) {
+                double lo = first + t > start ? first + t : start;
+                double hi = first + t + 1 < end ? first + t + 1 : end;
+                w[t] = (hi - lo) / scale;
+            }
+        } else {
+            double center = (i + 0.5) * scale - 0.5;
+            if(center < 0.0) center = 0.0;
+            first = (int)center;
+            if(first >= src_size - 1) {
+                first = src_size - 1;
+                count = 1;
+                w[0] = 1.0;
+            } else {
+                count = 2;
+                w[1] = center - first;
+                w[0] = 1.0 - w[1];
+            }
+        }
+        self->first[i] = first;
+        self->count[i] = count;
+    }
+}
+
+static void ResampleTable_free(ResampleTable* self) {
+    free(self->first);
+    free(self->count);
+    free(self->weights);
+}
+
+#define RESAMPLE_BAND_ROWS 32
+
+static void write_band(DitherImage* self, const double* band, int band_y, int rows,
+                       int width, int height, enum DitherRotation rotation) {
+    /* copies rows scaled rows starting at band_y into the DitherImage, turned by rotation. The loops run
+     * along the destination rows, so writes stay sequential while reads stay inside the small band */
+    ptrdiff_t base, step_x, step_y;
+    switch(rotation) {
+        case DITHER_ROTATE_90:
+            base = height - 1; step_x = height; step_y = -1;
+            break;
+        case DITHER_ROTATE_180:
+            base = (ptrdiff_t)(height - 1) * width + (width - 1); step_x = -1; step_y = -width;
+            break;
+        case DITHER_ROTATE_270:
+            base = (ptrdiff_t)(width - 1) * height; step_x = -height; step_y = 1;
+            break;
+        default:
+            base = 0; step_x = 1; step_y = width;
+            break;
+    }
+    float* dst = self->buffer + base + band_y * step_y;
+    if(step_x == 1 || step_x == -1) {
+        for(int y = 0; y < rows; y++) {
+            for(int x = 0; x < width; x++)
+                dst[y * step_y + x * step_x] = (float)band[y * width + x];
+        }
+    } else {
+        for(int x = 0; x < width; x++) {
+            for(int y = 0; y < rows; y++)
+                dst[x * step_x + y * step_y] = (float)band[y * width + x];
+        }
+    }
+}
+
+MODULE_API DitherImage* DitherImage_from_pixels_scaled(const uint8_t* pixels, int width, int height, int pitch,
+                                                       enum DitherPixelFormat format, enum DitherRotation rotation,
+                                                       bool correct_gamma, int scaled_width, int scaled_height) {
+    /* single pass: every source row is converted to linear grey and resampled horizontally once (a few of these rows
+     * are cached for the vertical filter), then bands of output rows are resampled vertically and written rotated */
+    int r_offset, g_offset, b_offset, bpp;
+    pixel_layout(format, &r_offset, &g_offset, &b_offset, &bpp);
+    bool rotated = rotation == DITHER_ROTATE_90 || rotation == DITHER_ROTATE_270;
+    DitherImage* self = rotated ? DitherImage_new(scaled_height, scaled_width) : DitherImage_new(scaled_width, scaled_height);
+    double (*lut)[256] = correct_gamma ? luma_lut_linear : luma_lut_srgb;
+    const double* lut_r = lut[0];
+    const double* lut_g = lut[1];
+    const double* lut_b = lut[2];
+
+    ResampleTable h_table, v_table;
+    ResampleTable_init(&h_table, width, scaled_width);
+    ResampleTable_init(&v_table, height, scaled_height);
+    int cache_rows = v_table.max_taps + 1;
+    double* grey = calloc((size_t)width, sizeof(double));
+    double* cache = calloc((size_t)(cache_rows * scaled_width), sizeof(double));
+    int* cache_src = calloc((size_t)cache_rows, sizeof(int));
+    for(int i = 0; i < cache_rows; i++) cache_src[i] = -1;
+    double* band = calloc((size_t)(RESAMPLE_BAND_ROWS * scaled_width), sizeof(double));
+
+    for(int oy = 0; oy < scaled_height; oy++) {
+        double* out_row = band + (oy % RESAMPLE_BAND_ROWS) * scaled_width;
+        const double* v_weights = v_table.weights + oy * v_table.max_taps;
+        for(int t = 0; t < v_table.count[oy]; t++) {
+            int sy = v_table.first[oy] + t;
+            double* h_row = cache + (sy % cache_rows) * scaled_width;
+            if(cache_src[sy % cache_rows] != sy) {
+                const uint8_t* src = pixels + (size_t)sy * (size_t)pitch;
+                for(int x = 0; x < width; x++, src += bpp)
+                    grey[x] = lut_r[src[r_offset]] + lut_g[src[g_offset]] + lut_b[src[b_offset]];
+                for(int x = 0; x < scaled_width; x++) {
+                    const double* h_weights = h_table.weights + x * h_table.max_taps;
+                    const double* g = grey + h_table.first[x];
+                    double sum = g[0] * h_weights[0];
+                    for(int u = 1; u < h_table.count[x]; u++) sum += g[u] * h_weights[u];
+                    h_row[x] = sum;
+                }
+                cache_src[sy % cache_rows] = sy;
+            }
+            double w = v_weights[t];
+            if(t == 0) {
+                for(int x = 0; x < scaled_width; x++) out_row[x] = h_row[x] * w;
+            } else {
+                for(int x = 0; x < scaled_width; x++) out_row[x] += h_row[x] * w;
+            }
+        }
+        if(oy % RESAMPLE_BAND_ROWS == RESAMPLE_BAND_ROWS - 1 || oy == scaled_height - 1) {
+            int band_y = oy - oy % RESAMPLE_BAND_ROWS;
+            write_band(self, band, band_y, oy - band_y + 1, scaled_width, scaled_height, rotation);
+        }
+    }
+
+    free(band);
+    free(cache_src);
+    free(cache);
+    free(grey);
+    ResampleTable_free(&v_table);
+    ResampleTable_free(&h_table);
+    return self;
+}
+
+MODULE_API DitherImage* DitherImage_from_pixels(const uint8_t* pixels, int width, int height, int pitch,
+                                                enum DitherPixelFormat format, enum DitherRotation rotation,
+                                                bool correct_gamma) {
+    /* at the same size every output pixel is its source pixel with weight 1.0, so this matches 'DitherImage_set_pixel' */
+    return DitherImage_from_pixels_scaled(pixels, width, height, pitch, format, rotation, correct_gamma, width, height);
+}
+
+MODULE_API void DitherImage_to_gray8(const DitherImage* self, bool correct_gamma, uint8_t* out) {
+    size_t count = (size_t)self->width * (size_t)self->height;
+    const double weight_sum = luma_lut_srgb[0][255] + luma_lut_srgb[1][255] + luma_lut_srgb[2][255];
+    for(size_t i = 0; i < count; i++) {
+        float value = self->buffer[i];
+        if(value < 0.0f) value = 0.0f;
+        if(value > 1.0f) value = 1.0f;
+        if(correct_gamma) {
+            out[i] = luma_encode_lut[(int)(value * LUMA_ENCODE_STEPS + 0.5f)];
+        } else {
+            double grey = value / weight_sum * 255.0 + 0.5;
+            out[i] = (uint8_t)(grey > 255.0 ? 255.0 : grey);
+        }
+    }
+}
+
+MODULE_API void DitherImage_set_gray8(DitherImage* self, const uint8_t* grey, bool correct_gamma) {
+    double (*lut)[256] = correct_gamma ? luma_lut_linear : luma_lut_srgb;
+    float values[256];
+    for(int v = 0; v < 256; v++)
+        values[v] = (float)(lut[0][v] + lut[1][v] + lut[2][v]);
+    size_t count = (size_t)self->width * (size_t)self->height;
+    for(size_t i = 0; i < count; i++)
+        self->buffer[i] = values[grey[i]];
+}
@@ -1,5 +1,10 @@
 #include <math.h>
 #include "libdither.h"
+#include "gamma.h"
+
+double luma_lut_linear[3][256];
+double luma_lut_srgb[3][256];
+unsigned char luma_encode_lut[LUMA_ENCODE_STEPS + 1];
 
 MODULE_API double gamma_decode(double c) {
     /* converts a sRGB input (in the range 0.0-1.0) to linear color space */
@@ -16,3 +21,26 @@ MODULE_API double gamma_encode(double c) {
     else
         return (1.055 * pow(c, (1.0 / 2.4))) - 0.055;
 }
+
+void gamma_init_luts(void) {
+    /* same weights and order of operations as DitherImage_set_pixel, so both give identical results */
+    const double weights[3] = {0.299, 0.586, 0.114};
+    for(int c = 0; c < 3; c++) {
+        for(int v = 0; v < 256; v++) {
+            luma_lut_linear[c][v] = gamma_decode(v / 255.0) * weights[c];
+            luma_lut_srgb[c][v] = (v / 255.0) * weights[c];
+        }
+    }
+    /* the greys are increasing, so one walk finds the nearest grey of every step. A step is at most 0.75 greys wide */
+    int v = 0;
+    for(int i = 0; i <= LUMA_ENCODE_STEPS; i++) {
+        double value = (double)i / LUMA_ENCODE_STEPS;
+        while(v < 255) {
+            double here = luma_lut_linear[0][v] + luma_lut_linear[1][v] + luma_lut_linear[2][v];
+            double next = luma_lut_linear[0][v + 1] + luma_lut_linear[1][v + 1] + luma_lut_linear[2][v + 1];
+            if(next - value >= value - here) break;
+            v++;
+        }
+        luma_encode_lut[i] = (unsigned char)v;
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+#ifndef GAMMA_H
+#define GAMMA_H
+
+/* per-channel lookup tables: 8 bit sRGB value -> its weighted share of the linear greyscale value.
+ * [0] = red, [1] = green, [2] = blue. Filled by the library initializer. */
+extern double luma_lut_linear[3][256];  // gamma corrected
+extern double luma_lut_srgb[3][256];    // without gamma correction
+/* linear greyscale value quantized to LUMA_ENCODE_STEPS + 1 steps -> nearest 8 bit grey of luma_lut_linear */
+#define LUMA_ENCODE_STEPS 4095
+extern unsigned char luma_encode_lut[LUMA_ENCODE_STEPS + 1];
+
+void gamma_init_luts(void);
+
+#endif  // GAMMA_H
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include "libdither.h"
+#include "gamma.h"
 
 #ifdef __cplusplus
 #define INITIALIZER(f) \
@@ -30,6 +31,7 @@ static void finalize(void) {
 
 INITIALIZER(initialize) {
     // library initializer code goes here...
+    gamma_init_luts();
     atexit(finalize);
 }
 
@@ -35,8 +35,8 @@ MODULE_API double gamma_encode(double c);
 /* **** DITHERIMAGE - INPUT IMAGE FOR DITHERERS **** */
 /* ************************************************* */
 
-/* data-structure for holding image data in linear color space */
-typedef struct Private_DoubleMatrix DitherImage;
+/* data-structure for holding image data in linear color space, single precision */
+typedef struct Private_FloatMatrix DitherImage;
 /* create a new DitherImage */
 MODULE_API DitherImage* DitherImage_new(int width, int height);
 /* frees the DitherImage's memory */
@@ -45,6 +45,44 @@ MODULE_API void DitherImage_free(DitherImage* self);
 MODULE_API void DitherImage_set_pixel(DitherImage* self, int x, int y, int r, int g, int b, bool correct_gamma);
 /* Returns a pixel. Returned pixels are in linear color space in the value range 0.0 - 1.0 */
 MODULE_API double DitherImage_get_pixel(DitherImage* self, int x, int y);
+/* creates a DitherImage from width x height linear greyscale values in the range 0.0 - 1.0 */
+MODULE_API DitherImage* DitherImage_from_doubles(const double* values, int width, int height);
+/* copies the image's width x height values into out */
+MODULE_API void DitherImage_to_doubles(const DitherImage* self, double* out);
+/* memory byte order of the pixels passed to 'DitherImage_from_pixels'. X bytes are ignored like alpha */
+enum DitherPixelFormat {
+    DITHER_PIXEL_RGBA32,
+    DITHER_PIXEL_BGRA32,
+    DITHER_PIXEL_ARGB32,
+    DITHER_PIXEL_ABGR32,
+    DITHER_PIXEL_RGB24,
+    DITHER_PIXEL_BGR24,
+    DITHER_PIXEL_GRAY8
+};
+/* clockwise rotation applied by 'DitherImage_from_pixels' */
+enum DitherRotation {
+    DITHER_ROTATE_NONE,
+    DITHER_ROTATE_90,
+    DITHER_ROTATE_180,
+    DITHER_ROTATE_270
+};
+/* creates a DitherImage from a whole image of width x height pixels in one pass, using lookup tables instead of
+ * per-pixel gamma math. pitch is the number of bytes per source row. With DITHER_ROTATE_90 and DITHER_ROTATE_270
+ * the DitherImage is height pixels wide. Gives the same values as 'DitherImage_set_pixel' */
+MODULE_API DitherImage* DitherImage_from_pixels(const uint8_t* pixels, int width, int height, int pitch,
+                                                enum DitherPixelFormat format, enum DitherRotation rotation,
+                                                bool correct_gamma);
+/* like 'DitherImage_from_pixels', but also resamples the image to scaled_width x scaled_height (the size before
+ * rotation) in the same pass: area averaging when shrinking, bilinear interpolation when enlarging. Resampling is
+ * done in linear color space */
+MODULE_API DitherImage* DitherImage_from_pixels_scaled(const uint8_t* pixels, int width, int height, int pitch,
+                                                       enum DitherPixelFormat format, enum DitherRotation rotation,
+                                                       bool correct_gamma, int scaled_width, int scaled_height);
+/* writes the image as width x height 8 bit greys into out, the inverse of 'DitherImage_from_pixels' with
+ * DITHER_PIXEL_GRAY8 and the same correct_gamma. Meant for 8 bit image processing before dithering */
+MODULE_API void DitherImage_to_gray8(const DitherImage* self, bool correct_gamma, uint8_t* out);
+/* replaces all pixels with width x height 8 bit greys, like 'DitherImage_from_pixels' with DITHER_PIXEL_GRAY8 */
+MODULE_API void DitherImage_set_gray8(DitherImage* self, const uint8_t* grey, bool correct_gamma);
 
 /* ********************************************* */
 /* **** BOSCH HERMAN INSPIRED GRID DITHERER **** */
@@ -73,6 +111,32 @@ MODULE_API void ErrorDiffusionMatrix_free(ErrorDiffusionMatrix* self);
  * serpentine: if the image should be traversed from top to bottom in a serpentine (left-to-right, right-to-left, etc.) manner
  * sigma: introduces jitter to the dither output to make it appear less regular. Recommended range: 0.0 - 1.0 */
 MODULE_API void error_diffusion_dither(const DitherImage* img, const ErrorDiffusionMatrix* m, bool serpentine, double sigma, uint8_t* out);
+/* data-structure for dithering an image in consecutive horizontal bands, carrying the error across band borders */
+typedef struct Private_ErrorDiffusionState ErrorDiffusionState;
+/* prepares the incremental error diffusion of an image. Parameters are the same as for 'error_diffusion_dither'.
+ * img must not be freed before the state. */
+MODULE_API ErrorDiffusionState* ErrorDiffusionState_new(const DitherImage* img, const ErrorDiffusionMatrix* m, bool serpentine, double sigma);
+/* frees the state's memory */
+MODULE_API void ErrorDiffusionState_free(ErrorDiffusionState* self);
+/* dithers the next 'rows' rows of the image into out (an output buffer for the whole image).
+ * returns the number of rows dithered, which is 0 once the whole image is done */
+MODULE_API int error_diffusion_dither_rows(ErrorDiffusionState* state, int rows, uint8_t* out);
+/* Fixed-point variant of 'error_diffusion_dither'. Built-in matrices run through kernels that are specialized at
+ * compile time, other matrices through a generic kernel. Much faster, but without jitter (sigma) */
+MODULE_API void fast_error_diffusion_dither(const DitherImage* img, const ErrorDiffusionMatrix* m, bool serpentine, uint8_t* out);
+/* data-structure for dithering an image in consecutive horizontal bands with the fixed-point ditherer */
+typedef struct Private_FastErrorDiffusionState FastErrorDiffusionState;
+/* prepares the incremental fixed-point error diffusion of an image. img must not be freed before the state. */
+MODULE_API FastErrorDiffusionState* FastErrorDiffusionState_new(const DitherImage* img, const ErrorDiffusionMatrix* m, bool serpentine);
+/* frees the state's memory */
+MODULE_API void FastErrorDiffusionState_free(FastErrorDiffusionState* self);
+/* dithers with up to 'threads' threads working on consecutive rows as a wavefront. The output does not change.
+ * Has to be called before the first rows are dithered. Returns the number of threads that will be used, which is
+ * 1 for serpentine states and on platforms without C11 atomics */
+MODULE_API int FastErrorDiffusionState_set_threads(FastErrorDiffusionState* self, int threads);
+/* dithers the next 'rows' rows of the image into out (an output buffer for the whole image).
+ * returns the number of rows dithered, which is 0 once the whole image is done */
+MODULE_API int fast_error_diffusion_dither_rows(FastErrorDiffusionState* state, int rows, uint8_t* out);
 /* below functions return different error diffusion matrices which can be used as input for 'error_diffusion_dither' */
 MODULE_API ErrorDiffusionMatrix* get_xot_matrix();
 MODULE_API ErrorDiffusionMatrix* get_diagonal_matrix();
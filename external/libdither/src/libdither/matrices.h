@@ -21,6 +21,12 @@ struct Private_DoubleMatrix {
     int height;
 };
 
+struct Private_FloatMatrix {
+    float* buffer;  // buffer for flat matrix array
+    int width;
+    int height;
+};
+
 struct Private_TilePattern {
     int* buffer;  // buffer for flat tiles array
     int  width;
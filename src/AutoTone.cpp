@@ -0,0 +1,158 @@
+#include "AutoTone.h"
+#include "ToneCurve.h"
+
+#include <string.h>
+#include <vector>
+
+using namespace Kbooth;
+
+void AutoTone::histogram(const uint8_t *gray, int w, int h, int stride, uint32_t hist[256]) {
+    // four partial histograms, so runs of equal pixels don't wait on the same counter;
+    // a scattered increment has no simd form that beats this on sse2 or neon
+    uint32_t partial[4][256];
+    memset(partial, 0, sizeof(partial));
+    for (int y = 0; y < h; y++) {
+        const uint8_t *row = gray + (size_t) y * stride;
+        int x = 0;
+        for (; x + 4 <= w; x += 4) {
+            partial[0][row[x]]++;
+            partial[1][row[x + 1]]++;
+            partial[2][row[x + 2]]++;
+            partial[3][row[x + 3]]++;
+        }
+        for (; x < w; x++) partial[0][row[x]]++;
+    }
+    for (int i = 0; i < 256; i++) hist[i] = partial[0][i] + partial[1][i] + partial[2][i] + partial[3][i];
+}
+
+static void applyRows(const ToneCurve &curve, uint8_t *gray, int w, int h, int stride) {
+    for (int y = 0; y < h; y++) {
+        uint8_t *row = gray + (size_t) y * stride;
+        curve.applyGray(row, row, (size_t) w);
+    }
+}
+
+void AutoTone::stretch(uint8_t *gray, int w, int h, int stride) {
+    if (w <= 0 || h <= 0) return;
+    uint32_t hist[256];
+    histogram(gray, w, h, stride, hist);
+    uint64_t count = (uint64_t) w * h;
+    uint64_t clip_black = count * CLIP_PERMILLE_BLACK / 1000;
+    uint64_t clip_white = count * CLIP_PERMILLE_WHITE / 1000;
+    int low = 0, high = 255;
+    for (uint64_t sum = hist[0]; low < 255 && sum <= clip_black; sum += hist[++low]) {}
+    for (uint64_t sum = hist[255]; high > 0 && sum <= clip_white; sum += hist[--high]) {}
+    // a flat image is stretched at most MAX_GAIN times, around its middle
+    int out_range = 255 - OUT_BLACK;
+    int min_range = (out_range + MAX_GAIN - 1) / MAX_GAIN;
+    if (high - low < min_range) {
+        int middle = (low + high) / 2;
+        low = middle - min_range / 2;
+        high = low + min_range;
+    }
+    unsigned char lut[256];
+    for (int i = 0; i < 256; i++) {
+        int value = OUT_BLACK + (i - low) * out_range / (high - low);
+        lut[i] = (unsigned char) (value < OUT_BLACK ? OUT_BLACK : value > 255 ? 255 : value);
+    }
+    applyRows(ToneCurve(lut), gray, w, h, stride);
+}
+
+// tile boundaries along one axis and, per pixel, the two nearest tile centers with the weight of the second
+struct TileAxis {
+    std::vector<int> start; // tiles + 1 entries
+    std::vector<int> first;
+    std::vector<int> weight; // 0..256
+};
+
+static void tileAxis(int size, int tiles, TileAxis *axis) {
+    axis->start.resize(tiles + 1);
+    for (int t = 0; t <= tiles; t++) axis->start[t] = (int) ((int64_t) size * t / tiles);
+    axis->first.resize(size);
+    axis->weight.resize(size);
+    // centers and pixels in doubled coordinates, so everything stays integer
+    auto center = [axis](int t) { return axis->start[t] + axis->start[t + 1]; };
+    int t = 0;
+    for (int p = 0; p < size; p++) {
+        int position = 2 * p + 1;
+        while (t + 1 < tiles && position >= center(t + 1)) t++;
+        axis->first[p] = t;
+        // before the first and after the last center only that tile counts
+        if (position <= center(t) || t + 1 >= tiles) axis->weight[p] = 0;
+        else axis->weight[p] = (position - center(t)) * 256 / (center(t + 1) - center(t));
+    }
+}
+
+void AutoTone::clahe(uint8_t *gray, int w, int h, int stride, int tiles_x, int tiles_y, int clip) {
+    if (tiles_x > w / 8) tiles_x = w / 8;
+    if (tiles_y > h / 8) tiles_y = h / 8;
+    if (tiles_x < 1 || tiles_y < 1) return;
+    TileAxis axis_x, axis_y;
+    tileAxis(w, tiles_x, &axis_x);
+    tileAxis(h, tiles_y, &axis_y);
+
+    // one equalizing lookup table per tile from its clipped histogram
+    std::vector<unsigned char> luts((size_t) tiles_x * tiles_y * 256);
+    int out_range = 255 - OUT_BLACK;
+    for (int ty = 0; ty < tiles_y; ty++) {
+        for (int tx = 0; tx < tiles_x; tx++) {
+            int x0 = axis_x.start[tx], y0 = axis_y.start[ty];
+            int tile_w = axis_x.start[tx + 1] - x0, tile_h = axis_y.start[ty + 1] - y0;
+            uint32_t hist[256];
+            histogram(gray + (size_t) y0 * stride + x0, tile_w, tile_h, stride, hist);
+            uint32_t count = (uint32_t) tile_w * tile_h;
+            uint32_t limit = clip * count / 256;
+            if (limit < 1) limit = 1;
+            uint32_t excess = 0;
+            for (int i = 0; i < 256; i++) {
+                if (hist[i] > limit) {
+                    excess += hist[i] - limit;
+                    hist[i] = limit;
+                }
+            }
+            // the clipped counts are spread over all bins, which limits the slope of the mapping
+            uint32_t share = excess / 256, rest = excess % 256;
+            unsigned char *lut = &luts[((size_t) ty * tiles_x + tx) * 256];
+            uint32_t cdf = 0;
+            for (int i = 0; i < 256; i++) {
+                cdf += hist[i] + share + ((uint32_t) i < rest ? 1 : 0);
+                lut[i] = (unsigned char) (OUT_BLACK + (uint64_t) cdf * out_range / count);
+            }
+        }
+    }
+
+    for (int y = 0; y < h; y++) {
+        uint8_t *row = gray + (size_t) y * stride;
+        int ty0 = axis_y.first[y], ty1 = ty0 + 1 < tiles_y ? ty0 + 1 : ty0;
+        int wy = axis_y.weight[y];
+        const unsigned char *top = &luts[(size_t) ty0 * tiles_x * 256];
+        const unsigned char *bottom = &luts[(size_t) ty1 * tiles_x * 256];
+        for (int x = 0; x < w; x++) {
+            int tx0 = axis_x.first[x], tx1 = tx0 + 1 < tiles_x ? tx0 + 1 : tx0;
+            int wx = axis_x.weight[x];
+            int v = row[x];
+            int upper = top[tx0 * 256 + v] * (256 - wx) + top[tx1 * 256 + v] * wx;
+            int lower = bottom[tx0 * 256 + v] * (256 - wx) + bottom[tx1 * 256 + v] * wx;
+            row[x] = (uint8_t) ((upper * (256 - wy) + lower * wy + 32768) >> 16);
+        }
+    }
+}
+
+void AutoTone::apply(AutoToneMode mode, uint8_t *gray, int w, int h, int stride) {
+    switch (mode) {
+        case AutoToneMode::Stretch:
+            stretch(gray, w, h, stride);
+            break;
+        case AutoToneMode::Clahe: {
+            // square tiles, CLAHE_TILES along the longer side
+            int tiles_x = w >= h ? CLAHE_TILES : (CLAHE_TILES * w + h / 2) / h;
+            int tiles_y = h > w ? CLAHE_TILES : (CLAHE_TILES * h + w / 2) / w;
+            clahe(gray, w, h, stride, tiles_x < 1 ? 1 : tiles_x, tiles_y < 1 ? 1 : tiles_y, CLAHE_CLIP);
+            // the clip limit keeps the tiles from using the whole range, the levels are set afterwards
+            stretch(gray, w, h, stride);
+            break;
+        }
+        default:
+            break;
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef KB_AUTO_TONE_H
+#define KB_AUTO_TONE_H
+
+#include <stdint.h>
+#include "Kbooth.h"
+
+namespace Kbooth {
+
+    /**
+     * Automatic tone mapping of the print-bound 8 bit gray image, right
+     * before dithering. Dithered thermal paper only separates a narrow
+     * range of tones: near black prints as a solid, smeared area and a few
+     * stray dots make highlights look dirty. So shadows are lifted to
+     * OUT_BLACK and highlights are pushed to clean paper white.
+     *
+     * All functions work on a w x h region of rows stride bytes apart and
+     * use integer histograms only.
+     */
+    struct AutoTone {
+        static const int OUT_BLACK = 24; // darkest output, keeps texture in the shadows
+        static const int CLIP_PERMILLE_BLACK = 1; // of the pixels stretched to black
+        static const int CLIP_PERMILLE_WHITE = 5; // ... and to white, faces should not burn out first
+        static const int MAX_GAIN = 3; // stretch of low contrast images, more only amplifies noise
+        static const int CLAHE_TILES = 8; // along the longer side
+        static const int CLAHE_CLIP = 3; // histogram bins are clipped at this multiple of the average bin
+
+        static void histogram(const uint8_t *gray, int w, int h, int stride, uint32_t hist[256]);
+        // maps the clipped histogram range to OUT_BLACK..255
+        static void stretch(uint8_t *gray, int w, int h, int stride);
+        // equalizes tiles_x x tiles_y tiles, bilinearly interpolating between the lookup tables of the tiles
+        static void clahe(uint8_t *gray, int w, int h, int stride, int tiles_x, int tiles_y, int clip);
+        static void apply(AutoToneMode mode, uint8_t *gray, int w, int h, int stride);
+    };
+}
+
+#endif // KB_AUTO_TONE_H
@@ -1,6 +1,9 @@
 #include "Camera.h"
+#include "FormatProbe.h"
+#include "ImageOps.h"
 #include "Kbooth.h"
-#include "Printer.h"
+#include "PrintWorker.h"
+#include "ToneCurve.h"
 
 #include "SDL3/SDL_render.h"
 #include "SDL3/SDL_surface.h"
@@ -11,46 +14,101 @@
 #include <string>
 #include <sstream>
 #include <ctime>
+#include <algorithm>
 #include <math.h>
 
 using namespace Kbooth;
 
-void SDL_AdjustBrightnessContrast(SDL_Surface* surface, int brightness, float contrast) {
-	if (!SDL_LockSurface(surface)) {
-        return; // handle error as needed
+// rough cost of bringing a frame of format to the screen and the printer
+static int formatConversionCost(SDL_PixelFormat format) {
+    switch (format) {
+        case SDL_PIXELFORMAT_NV12:
+        case SDL_PIXELFORMAT_NV21:
+            return 0; // converted by the renderer, luma plane is the print gray
+        case SDL_PIXELFORMAT_IYUV:
+        case SDL_PIXELFORMAT_YV12:
+            return 1;
+        case SDL_PIXELFORMAT_YUY2:
+        case SDL_PIXELFORMAT_UYVY:
+        case SDL_PIXELFORMAT_YVYU:
+            return 3; // most renderers convert packed yuv on the cpu
+        case SDL_PIXELFORMAT_MJPG:
+            return 4; // jpeg decode per frame, though at reduced scale
+        default:
+            return SDL_ISPIXELFORMAT_FOURCC(format) ? 4 : 2; // rgb is uploaded as is
     }
+}
 
-    const SDL_PixelFormatDetails* fmt = SDL_GetPixelFormatDetails(surface->format);
-    SDL_Palette* palette = SDL_GetSurfacePalette(surface); // NULL if not indexed
-
-    Uint32* pixels = (Uint32*)surface->pixels;
-    int pixelCount = (surface->pitch / 4) * surface->h; // assumes 32-bit format
-
-    for (int i = 0; i < pixelCount; i++) {
-        Uint8 r, g, b, a;
-        SDL_GetRGBA(pixels[i], fmt, palette, &r, &g, &b, &a);
-
-        float rf = contrast * (r - 128) + 128 + brightness;
-        float gf = contrast * (g - 128) + 128 + brightness;
-        float bf = contrast * (b - 128) + 128 + brightness;
-
-        r = (Uint8)fminf(fmaxf(rf, 10.0f), 255.0f);
-        g = (Uint8)fminf(fmaxf(gf, 10.0f), 255.0f);
-        b = (Uint8)fminf(fmaxf(bf, 10.0f), 255.0f);
-
-        pixels[i] = SDL_MapRGBA(fmt, palette, r, g, b, a);
+// picks the cheapest format that still gives a smooth preview, up to full hd
+static int preferredFormatIndex(SDL_CameraSpec **specs, int count) {
+    const float MIN_PREVIEW_FPS = 24.0f;
+    const long MAX_USEFUL_AREA = 1920L * 1080L;
+    int best = -1;
+    long best_key[4];
+    for (int i = 0; i < count; i++) {
+        float framerate = (float) specs[i]->framerate_numerator / specs[i]->framerate_denominator;
+        long area = (long) specs[i]->width * specs[i]->height;
+        // compared in order, smaller is better
+        long key[4] = {
+            framerate >= MIN_PREVIEW_FPS ? 0L : 1L,
+            (long) formatConversionCost(specs[i]->format),
+            -(area < MAX_USEFUL_AREA ? area : MAX_USEFUL_AREA),
+            -(long) framerate
+        };
+        if (best < 0 || std::lexicographical_compare(key, key + 4, best_key, best_key + 4)) {
+            best = i;
+            std::copy(key, key + 4, best_key);
+        }
     }
-
-    SDL_UnlockSurface(surface);	
+    return best;
 }
 
+// uploads frame, planar yuv plane by plane so the renderer converts it on the gpu
+static bool updateFrameTexture(SDL_Texture *texture, const CameraFrame *frame) {
+    if (frame->format == SDL_PIXELFORMAT_MJPG) {
+        return SDL_UpdateTexture(texture, NULL, frame->preview.data(), frame->preview_pitch);
+    }
+    const Uint8 *luma = frame->lumaPlane();
+    if (luma == nullptr) return SDL_UpdateTexture(texture, NULL, frame->pixels.data(), frame->pitch);
+
+    const Uint8 *chroma = luma + (size_t) frame->pitch * frame->h;
+    int chroma_pitch = (frame->pitch + 1) / 2;
+    const Uint8 *chroma_second = chroma + (size_t) chroma_pitch * ((frame->h + 1) / 2);
+    switch (frame->format) {
+        case SDL_PIXELFORMAT_NV12:
+        case SDL_PIXELFORMAT_NV21: // interleaved chroma, full pitch
+            return SDL_UpdateNVTexture(texture, NULL, luma, frame->pitch, chroma, frame->pitch);
+        case SDL_PIXELFORMAT_IYUV: // Y, U, V
+            return SDL_UpdateYUVTexture(texture, NULL, luma, frame->pitch,
+                                        chroma, chroma_pitch, chroma_second, chroma_pitch);
+        default: // YV12: Y, V, U
+            return SDL_UpdateYUVTexture(texture, NULL, luma, frame->pitch,
+                                        chroma_second, chroma_pitch, chroma, chroma_pitch);
+    }
+}
 
 Camera::Camera() : 
 	texture(nullptr),
 	capture_texture(nullptr),
 	capture_surface(nullptr),
 	camera(nullptr),
+	output_w(0),
+	output_h(0),
+	output_size_valid(false),
+	frame_aspect_x(0),
+	frame_aspect_y(0),
+	feed_layout({.valid = false}),
+	format_ini(nullptr),
+	format_target(nullptr),
+	state(CameraState::Closed),
+	device_spec_valid(false),
+	requested_format_index(-1),
+	logo_texture(nullptr),
+	attract_drawn_at(0),
+	burst({.active = false, .shots = 0}),
+	last_frame(nullptr),
 	image_count(0) {
+    frame_event_type = SDL_RegisterEvents(1);
     cameras = SDL_GetCameras(&cameras_size);
     char font[] = "../assets/fonts/Anton.ttf"; // default font
     countdown_font = TTF_OpenFont(font, 800);
@@ -90,12 +148,50 @@ const char ** Camera::getAvailCameraNames(int *size) {
 	return camera_names;
 }
 
+void Camera::updateOutputSize(SDL_Renderer *renderer) {
+    if (output_size_valid) return;
+    SDL_GetRenderOutputSize(renderer, &output_w, &output_h);
+    output_size_valid = true;
+    frame_aspect_x = 0; // force frame, bars and layouts to be recomputed
+    feed_layout.valid = false;
+}
+
+void Camera::invalidateLayout() {
+    output_size_valid = false;
+}
+
+bool Camera::needsRedraw() {
+    const Uint64 ATTRACT_FRAME_MS = 66;
+    if (state != CameraState::Streaming) return SDL_GetTicks() - attract_drawn_at >= ATTRACT_FRAME_MS;
+    return countdown.active || capture.hasNewFrame();
+}
+
+CameraState Camera::getState() {
+    return state;
+}
+
+void Camera::setFormatSelection(CSimpleIniA *ini, const FormatTarget *target) {
+    format_ini = ini;
+    format_target = target;
+}
+
+Uint32 Camera::getFrameEventType() {
+    return frame_event_type;
+}
+
+FrameStats *Camera::getFrameStats() {
+    return &stats;
+}
+
 void Camera::setAspectRatio(SDL_Renderer *renderer, int aspect_x, int aspect_y) {
+        updateOutputSize(renderer);
+        if (aspect_x == frame_aspect_x && aspect_y == frame_aspect_y) return;
+        frame_aspect_x = aspect_x;
+        frame_aspect_y = aspect_y;
         frame = {0};
         framing_bar_start = {0};
         framing_bar_end = {0};
-		int win_w, win_h;
-		SDL_GetRenderOutputSize(renderer, &win_w, &win_h);
+		int win_w = output_w, win_h = output_h;
         float aspect_win = ((float) win_w) / win_h;
         float aspect_frame = ((float) aspect_x) / aspect_y;
         if (aspect_frame > aspect_win) {
@@ -124,6 +220,10 @@ void Camera::setAspectRatio(SDL_Renderer *renderer, int aspect_x, int aspect_y)
 }
 
 const char ** Camera::getAvailFormatNames(int camera_index, int *formats_size) {
+    if (camera_index < 0 || camera_index >= cameras_size) {
+        *formats_size = 0;
+        return new const char*[0];
+    }
     SDL_CameraSpec **specs = SDL_GetCameraSupportedFormats(cameras[camera_index], formats_size);
     const char **specs_description = new const char*[*formats_size];
 
@@ -131,7 +231,8 @@ const char ** Camera::getAvailFormatNames(int camera_index, int *formats_size) {
         float framerate = (float) specs[i]->framerate_numerator / specs[i]->framerate_denominator;
         std::stringstream description_stream;
         description_stream << specs[i]->width << "x" << specs[i]->height
-                          << " " << framerate << "fps (" << specs[i]->colorspace << ")";
+                          << " " << framerate << "fps " << SDL_GetPixelFormatName(specs[i]->format)
+                          << " (" << specs[i]->colorspace << ")";
 
         std::string description = description_stream.str();
         specs_description[i] = new char[description.size() + 1];
@@ -163,19 +264,101 @@ void Camera::cleanup() {
 		SDL_DestroyTexture(texture);
 		texture = nullptr;
 	}
+    closeDevice();
+    if (cameras != nullptr) {
+        SDL_free(cameras);
+        cameras = nullptr;
+    }
+}
+
+void Camera::closeDevice() {
+	if (texture != nullptr) {
+		SDL_DestroyTexture(texture);
+		texture = nullptr;
+	}
     if (camera != nullptr) { //close old camera
+        capture.stop();
         SDL_CloseCamera(camera);
 		camera = nullptr;
     }
-    if (cameras != nullptr) {
-        SDL_free(cameras);
+}
+
+void Camera::refreshCameraList() {
+    if (cameras != nullptr) SDL_free(cameras);
+    cameras = SDL_GetCameras(&cameras_size);
+    if (cameras == nullptr) cameras_size = 0;
+}
+
+void Camera::startStreaming() {
+    std::cout << "Opened Camera: " << device_name << std::endl;
+    capture.start(camera, frame_event_type);
+    state = CameraState::Streaming;
+}
+
+void Camera::handleEvent(SDL_Event *event) {
+    SDL_CameraID opened_id = camera != nullptr ? SDL_GetCameraID(camera) : 0;
+    switch (event->type) {
+        case SDL_EVENT_CAMERA_DEVICE_APPROVED:
+            if (event->cdevice.which == opened_id && state == CameraState::WaitingForPermission) startStreaming();
+            break;
+        case SDL_EVENT_CAMERA_DEVICE_DENIED:
+            if (event->cdevice.which == opened_id) {
+                std::cerr << "ERROR: camera permission denied" << std::endl;
+                closeDevice();
+                state = CameraState::Denied;
+            }
+            break;
+        case SDL_EVENT_CAMERA_DEVICE_REMOVED:
+            if (event->cdevice.which == opened_id) {
+                std::cout << "Camera disconnected: " << device_name << std::endl;
+                closeDevice();
+                countdown.active = false;
+                burst.active = false;
+                capture.setPreroll(false);
+                last_frame = nullptr;
+                state = CameraState::Disconnected;
+            }
+            refreshCameraList();
+            break;
+        case SDL_EVENT_CAMERA_DEVICE_ADDED:
+            refreshCameraList();
+            if (state == CameraState::Disconnected || state == CameraState::Closed) reopen(event->cdevice.which);
+            break;
+        default:
+            break;
+    }
+}
+
+void Camera::reopen(SDL_CameraID camera_id) {
+    const char *name = SDL_GetCameraName(camera_id);
+    // after a disconnect only the same device, if nothing was open any camera will do
+    if (state == CameraState::Disconnected && (name == nullptr || device_name != name)) return;
+
+    int camera_index = -1;
+    for (int i = 0; i < cameras_size; i++) {
+        if (cameras[i] == camera_id) camera_index = i;
     }
+    if (camera_index < 0) return;
+
+    int format_index = requested_format_index;
+    if (device_spec_valid) { // the ids and format indices may have changed, match the format itself
+        int count;
+        SDL_CameraSpec **specs = SDL_GetCameraSupportedFormats(camera_id, &count);
+        std::string key = FormatProbe::specKey(&device_spec);
+        for (int i = 0; specs != nullptr && i < count; i++) {
+            if (FormatProbe::specKey(specs[i]) == key) format_index = i;
+        }
+        SDL_free(specs);
+    }
+    std::cout << "Camera connected, reopening: " << (name != nullptr ? name : "") << std::endl;
+    open(camera_index, format_index);
 }
 
 Camera::~Camera() {
     TTF_CloseFont(countdown_border_font);
     TTF_CloseFont(countdown_font);
     SDL_DestroySurface(logo_image);
+    if (logo_texture != nullptr) SDL_DestroyTexture(logo_texture);
 	cleanup();
 	std::cout << "Closing Camera Resources" << std::endl;
 }
@@ -183,6 +366,8 @@ Camera::~Camera() {
 bool Camera::open(int camera_index, int format_index) {
 	countdown = {.active = false, .update = true, .position = 3, .start_time = 0};
 	cleanup();
+    state = CameraState::Closed;
+    requested_format_index = format_index;
     cameras = SDL_GetCameras(&cameras_size);
     if (cameras_size == 0 || cameras == nullptr) {
         std::cout << "No available Cameras" << std::endl;
@@ -197,11 +382,28 @@ bool Camera::open(int camera_index, int format_index) {
 	// Get selected format
 	int count;
 	SDL_CameraSpec **specs = SDL_GetCameraSupportedFormats(cameras[camera_index], &count);
+	const char *name = SDL_GetCameraName(cameras[camera_index]);
+    device_name = name != nullptr ? name : "";
+    device_spec_valid = false;
 	
 	if (format_index >= 0 && format_index < count) {
+        device_spec = *specs[format_index];
+        device_spec_valid = true;
     	camera = SDL_OpenCamera(cameras[camera_index], specs[format_index]);
 	} else if (format_index < 0) {
-    	camera = SDL_OpenCamera(cameras[camera_index], NULL);
+        // automatic: the best probed format that meets the target, else by conversion cost
+        int preferred = -1;
+        if (format_ini != nullptr && format_target != nullptr) {
+            const char *name = SDL_GetCameraName(cameras[camera_index]);
+            preferred = FormatProbe::select(FormatProbe::load(format_ini, name), specs, count, format_target);
+        }
+        if (preferred < 0) preferred = preferredFormatIndex(specs, count);
+        if (preferred >= 0) {
+            std::cout << "Selected camera format: " << FormatProbe::specKey(specs[preferred]) << std::endl;
+            device_spec = *specs[preferred];
+            device_spec_valid = true;
+        }
+    	camera = SDL_OpenCamera(cameras[camera_index], preferred >= 0 ? specs[preferred] : NULL);
 	} else {
 		SDL_free(specs);
         std::cout << "Selected Format not available: " << format_index << std::endl;
@@ -214,52 +416,40 @@ bool Camera::open(int camera_index, int format_index) {
         return false;
     }
 
-	// wait for permission 
-	int permission = 0;
-	while(permission == 0) {
-		permission = SDL_GetCameraPermissionState(camera);
-	}
-	if (permission == 1) {
-    	std::cout << "Opened Camera with ID: " << cameras[camera_index] << std::endl;
-		return true;
+    // the permission is granted (or denied) later by an event
+	int permission = SDL_GetCameraPermissionState(camera);
+	if (permission < 0) {
+        std::cerr << "ERROR: camera permission denied" << std::endl;
+        closeDevice();
+        state = CameraState::Denied;
+        return false;
 	}
-    return false;
+    state = CameraState::WaitingForPermission;
+	if (permission > 0) startStreaming();
+    return true;
 }
 
-void Camera::saveAndPrintImage(Printer *printer, PrintSettings *print_set) {
+void Camera::saveAndPrintImage(PrintWorker *print_worker, PrintSettings *print_set) {
+    capture.setPreroll(false);
+    std::string filename;
     if (print_set->save_images) {
-		std::string filename = print_set->save_folder + "/"; 
+		filename = print_set->save_folder + "/"; 
         filename += getDateAndTime() + "_" + std::to_string(++image_count) + ".jpg";
-        IMG_SaveJPG(capture_surface, filename.c_str(), 100);
-    }
-	if (print_set->print_images && capture_surface != nullptr && logo_image != nullptr) {
-        float scale = (float) capture_surface->w / logo_image->w;
-        SDL_Surface *logo_surf = SDL_CreateSurface(
-            capture_surface->w,
-            capture_surface->h + logo_image->h * scale,
-            capture_surface->format
-        );
-
-        SDL_Rect capt_r = {
-            .x = 0, .y = 0,
-            .w = capture_surface->w, .h = capture_surface->h
-        };
-
-        SDL_Rect logo_r = {
-            .x = 0, .y = capture_surface->h,
-            .w = (int) (logo_image->w * scale), .h = (int) (logo_image->h * scale)
-        };
-
-		SDL_AdjustBrightnessContrast(capture_surface, print_set->brightness, print_set->contrast);
-        SDL_BlitSurface(capture_surface, NULL, logo_surf, &capt_r);
-        SDL_BlitSurfaceScaled(logo_image, NULL, logo_surf, &logo_r, SDL_SCALEMODE_NEAREST);
-        printer->printSdlSurface(logo_surf, print_set);
-        //IMG_SaveJPG(logo_surf, "images/test.jpg", 100);
-        SDL_DestroySurface(logo_surf);
-        
+    }
+	if (capture_surface != nullptr && (print_set->save_images || print_set->print_images)) {
+        if (print_set->layout != print_layout.getName()) print_layout.load(print_set->layout);
+        std::shared_ptr<const LayoutRaster> layout = print_set->print_images ? print_layout.prepare() : nullptr;
+        // the worker owns the surface from here on
+        print_worker->submit(capture_surface, layout, print_set, filename, strip_tiles);
+        capture_surface = nullptr;
 	}
+	if (capture_surface != nullptr) {
+		SDL_DestroySurface(capture_surface);
+		capture_surface = nullptr;
+	}
+	strip_tiles.clear();
 	if (capture_texture != nullptr) {
-		SDL_DestroyTexture(texture);
+		SDL_DestroyTexture(capture_texture);
 		capture_texture = nullptr;
 	}
 	if (texture != nullptr) { // destroy old texture
@@ -299,8 +489,8 @@ void Camera::renderCountdown(SDL_Renderer *renderer) {
         createCountdownTexture(renderer);
         countdown.update = false;
     }
-    int win_w, win_h;
-    SDL_GetRenderOutputSize(renderer, &win_w, &win_h);
+    updateOutputSize(renderer);
+    int win_w = output_w, win_h = output_h;
     float relative_font_scale = 0.5f + countdown.progression * countdown.progression * 0.9f;
     SDL_FRect d;
     d.h = win_h * relative_font_scale;
@@ -311,8 +501,38 @@ void Camera::renderCountdown(SDL_Renderer *renderer) {
     SDL_RenderTexture(renderer, countdown_texture, NULL, &d);
 }
 
+void Camera::renderAttractScreen(SDL_Renderer *renderer) {
+    attract_drawn_at = SDL_GetTicks();
+    if (logo_texture == nullptr && logo_image != nullptr) {
+        logo_texture = SDL_CreateTextureFromSurface(renderer, logo_image);
+    }
+    if (logo_texture == nullptr) return;
+    updateOutputSize(renderer);
+    // slowly breathing logo until there is a camera picture
+    float pulse = 0.5f + 0.5f * sinf((float) attract_drawn_at / 3000.0f * 2.0f * (float) M_PI);
+    float scale = fminf(output_w * 0.5f / logo_texture->w, output_h * 0.5f / logo_texture->h);
+    SDL_FRect d;
+    d.w = logo_texture->w * scale;
+    d.h = logo_texture->h * scale;
+    d.x = (output_w - d.w) / 2.0f;
+    d.y = (output_h - d.h) / 2.0f;
+    SDL_SetTextureAlphaMod(logo_texture, (Uint8) (120 + pulse * 135));
+    SDL_RenderTexture(renderer, logo_texture, NULL, &d);
+}
+
 bool Camera::renderFrame(SDL_Renderer *renderer, Settings *settings) {
-    if (countdown.position < 1 && countdown.active) {
+    if (state == CameraState::WaitingForPermission && SDL_GetCameraPermissionState(camera) > 0) {
+        startStreaming(); // in case the approval event went to another loop
+    }
+    if (state != CameraState::Streaming) {
+        renderAttractScreen(renderer);
+        return true;
+    }
+    if (burst.active) {
+        bool res = renderCameraFeed(renderer, &settings->framing, true);
+        renderBurst(renderer, settings);
+        return res;
+    } else if (countdown.position < 1 && countdown.active) {
         // render image capture animation 
         return renderImageCapture(renderer, settings); 
     } else if (countdown.active) {
@@ -324,24 +544,70 @@ bool Camera::renderFrame(SDL_Renderer *renderer, Settings *settings) {
     }
 }
 
+void Camera::renderBurst(SDL_Renderer *renderer, Settings *settings) {
+    Uint64 now = SDL_GetTicks();
+    int total = (int) burst_pool.size();
+    Uint64 next_shot_at = burst.start_time + (Uint64) burst.shots * settings->countdown.burst_interval;
+    if (burst.shots < total && now >= next_shot_at && last_frame != nullptr) {
+        // copies into the pooled buffers, their capacity was reserved by startCountdown
+        burst_pool[burst.shots] = *last_frame;
+        burst.shots++;
+        burst.flash_time = now;
+    }
+    updateOutputSize(renderer);
+
+    // short white flash per shot
+    const float FLASH_MS = 200.0f;
+    float flash = 1.0f - (float) (now - burst.flash_time) / FLASH_MS;
+    if (burst.shots > 0 && flash > 0.0f) {
+        SDL_SetRenderDrawColor(renderer, 255, 255, 255, (Uint8) (flash * 200));
+        SDL_RenderFillRect(renderer, NULL);
+    }
+    // one box per shot, filled once taken
+    float size = output_h / 24.0f;
+    float spacing = size * 0.5f;
+    float x = (output_w - total * size - (total - 1) * spacing) / 2.0f;
+    SDL_SetRenderDrawColor(renderer, countdown_color.r, countdown_color.g, countdown_color.b, 255);
+    for (int i = 0; i < total; i++, x += size + spacing) {
+        SDL_FRect box = {.x = x, .y = output_h - size * 2.0f, .w = size, .h = size};
+        if (i < burst.shots) SDL_RenderFillRect(renderer, &box);
+        else SDL_RenderRect(renderer, &box);
+    }
+}
+
 bool Camera::renderCameraFeed(SDL_Renderer *renderer, Framing *framing, bool renderBorder) {
-    Uint64 timestampNS;
-    SDL_Surface *frame = SDL_AcquireCameraFrame(camera, &timestampNS);
+    bool fresh;
+    const CameraFrame *frame = capture.latest(&fresh);
+    last_frame = frame;
 
     setAspectRatio(renderer, framing->aspect_x, framing->aspect_y);
-    if (frame != NULL) {
+    if (frame != nullptr) {
+        // previews of compressed frames are decoded smaller, zoomed in needs more pixels
+        float zoom = framing->zoom > 1.0f ? framing->zoom : 1.0f;
+        capture.setPreviewSize((int) (output_w * zoom), (int) (output_h * zoom));
+    }
+    if (frame != nullptr && (fresh || texture == nullptr)) {
+        bool compressed = frame->format == SDL_PIXELFORMAT_MJPG;
+        SDL_PixelFormat texture_format = compressed ? SDL_PIXELFORMAT_RGBX32 : frame->format;
+        int texture_w = compressed ? frame->preview_w : frame->w;
+        int texture_h = compressed ? frame->preview_h : frame->h;
+        if (texture != nullptr && (texture->w != texture_w || texture->h != texture_h || texture->format != texture_format)) {
+            SDL_DestroyTexture(texture); // the camera was reopened with another format
+            texture = nullptr;
+        }
         if (texture != nullptr) {
-            SDL_UpdateTexture(texture, NULL, frame->pixels, frame->pitch);
+            updateFrameTexture(texture, frame);
+            stats.frameUploaded(frame, SDL_GetTicksNS());
         } else {
 
 			std::cout << "created texture: " << std::endl;
-            SDL_Colorspace colorspace = SDL_GetSurfaceColorspace(frame);
+            SDL_Colorspace colorspace = compressed ? SDL_COLORSPACE_SRGB : frame->colorspace;
             SDL_PropertiesID props = SDL_CreateProperties();
-            SDL_SetNumberProperty(props, SDL_PROP_TEXTURE_CREATE_FORMAT_NUMBER, frame->format);
+            SDL_SetNumberProperty(props, SDL_PROP_TEXTURE_CREATE_FORMAT_NUMBER, texture_format);
             SDL_SetNumberProperty(props, SDL_PROP_TEXTURE_CREATE_COLORSPACE_NUMBER, colorspace);
             SDL_SetNumberProperty(props, SDL_PROP_TEXTURE_CREATE_ACCESS_NUMBER, SDL_TEXTUREACCESS_STREAMING);
-            SDL_SetNumberProperty(props, SDL_PROP_TEXTURE_CREATE_WIDTH_NUMBER, frame->w);
-            SDL_SetNumberProperty(props, SDL_PROP_TEXTURE_CREATE_HEIGHT_NUMBER, frame->h);
+            SDL_SetNumberProperty(props, SDL_PROP_TEXTURE_CREATE_WIDTH_NUMBER, texture_w);
+            SDL_SetNumberProperty(props, SDL_PROP_TEXTURE_CREATE_HEIGHT_NUMBER, texture_h);
             texture = SDL_CreateTextureWithProperties(renderer, props);
             SDL_DestroyProperties(props);
             if (texture == NULL) {
@@ -349,24 +615,52 @@ bool Camera::renderCameraFeed(SDL_Renderer *renderer, Framing *framing, bool ren
 				texture = nullptr;
 				return false;
             }
+            updateFrameTexture(texture, frame);
+            stats.frameUploaded(frame, SDL_GetTicksNS());
         }
-        SDL_ReleaseCameraFrame(camera, frame);
     }
 
-	if (!texture) return true;
-	renderTexture(renderer, texture, framing, renderBorder);
+	if (!texture) {
+        renderAttractScreen(renderer);
+        return true;
+    }
+	renderTexture(renderer, texture, framing, renderBorder, &feed_layout);
 	return true;
 }
 
 bool Camera::renderImageCapture(SDL_Renderer *renderer, Settings *settings) {
 	if (capture_texture == nullptr) {
-		Uint64 timestampNS;
-
-        bool err = !renderCameraFeed(renderer, &settings->framing, false);
-		if (err) return false;
+        // prints are gray, so without saving the luma plane of yuv frames is enough
+        bool gray = !settings->print_settings.save_images;
+        strip_tiles.clear();
+        if (burst.shots > 1) {
+            capture_surface = ImageOps::composeStrip(burst_pool.data(), burst.shots, &settings->framing, gray,
+                                                     STRIP_WIDTH, STRIP_GAP, &strip_tiles);
+        } else {
+            // keep showing the feed until the frames after the shutter arrived
+            Uint64 now_ns = SDL_GetTicksNS();
+            if (countdown.shutter_ns == 0) countdown.shutter_ns = now_ns;
+            if (now_ns < countdown.shutter_ns + SHUTTER_WINDOW_NS) {
+                return renderCameraFeed(renderer, &settings->framing, true);
+            }
+            // take the still from the raw camera frame at sensor resolution, the sharpest around the shutter
+            const CameraFrame *raw_frame = &still;
+            if (!capture.sharpest(countdown.shutter_ns - SHUTTER_WINDOW_NS, countdown.shutter_ns + SHUTTER_WINDOW_NS,
+                                  &still)) {
+                bool fresh;
+                raw_frame = capture.latest(&fresh);
+                last_frame = nullptr;
+            }
+            capture_surface = ImageOps::captureFramed(raw_frame, &settings->framing, gray);
+        }
+        if (capture_surface == nullptr) {
+            // format the cpu path cannot decode, read back the preview instead
+            bool err = !renderCameraFeed(renderer, &settings->framing, false);
+            if (err) return false;
 
-        setAspectRatio(renderer, settings->framing.aspect_x, settings->framing.aspect_y);
-		capture_surface = SDL_RenderReadPixels(renderer, &frame);
+            setAspectRatio(renderer, settings->framing.aspect_x, settings->framing.aspect_y);
+            capture_surface = SDL_RenderReadPixels(renderer, &frame);
+        }
 		if (capture_surface == NULL) return true;
 
 		SDL_Colorspace colorspace = SDL_GetSurfaceColorspace(capture_surface);
@@ -384,11 +678,22 @@ bool Camera::renderImageCapture(SDL_Renderer *renderer, Settings *settings) {
 		}
 
 		std::cout << "created capture_texture: " << std::endl;
+
+        // uploaded once; shows the tone of the print while printing is on
+        void *texture_pixels;
+        int texture_pitch;
+        bool toned = settings->print_settings.print_images && capture_surface->format == SDL_PIXELFORMAT_RGBA32;
+        if (toned && SDL_LockTexture(capture_texture, NULL, &texture_pixels, &texture_pitch)) {
+            ToneCurve tone(&settings->print_settings);
+            tone.applyRGBA((const uint8_t*) capture_surface->pixels, capture_surface->pitch,
+                           (uint8_t*) texture_pixels, texture_pitch, capture_surface->w, capture_surface->h);
+            SDL_UnlockTexture(capture_texture);
+        } else {
+            SDL_UpdateTexture(capture_texture, NULL, capture_surface->pixels, capture_surface->pitch);
+        }
     }
 
 	if (!capture_texture) return true;
-
-    SDL_UpdateTexture(capture_texture, NULL, capture_surface->pixels, capture_surface->pitch);
 	
 	// Animate Image Capture
  	Framing new_frame = {.zoom = 0.8, .pos_x = 0.0, .pos_y = 0.0, .mirror = false, .rotation = 0.0f};
@@ -399,7 +704,7 @@ bool Camera::renderImageCapture(SDL_Renderer *renderer, Settings *settings) {
 	new_frame.zoom = 1.0 - (inverse_lerp * 0.5);
 	new_frame.pos_y = inverse_lerp * 4;
     
-    bool err = !renderTexture(renderer, capture_texture, &new_frame, false);
+    bool err = !renderTexture(renderer, capture_texture, &new_frame, false, nullptr);
     if (err) return err;
 
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, inverse_lerp * 255);
@@ -412,10 +717,18 @@ bool Camera::renderTexture(
     SDL_Renderer *renderer, 
     SDL_Texture *texture, 
     Framing *framing, 
-    bool renderBorder) {
+    bool renderBorder,
+    TextureLayout *layout) {
+
+    updateOutputSize(renderer);
+    if (layout != nullptr && layout->valid &&
+        layout->out_w == output_w && layout->out_h == output_h &&
+        layout->tex_w == texture->w && layout->tex_h == texture->h &&
+        layout->zoom == framing->zoom && layout->pos_x == framing->pos_x && layout->pos_y == framing->pos_y) {
+        return renderTextureAt(renderer, texture, &layout->dst, framing, renderBorder);
+    }
 
-	int win_w, win_h;
-	SDL_GetRenderOutputSize(renderer, &win_w, &win_h);
+	int win_w = output_w, win_h = output_h;
 
 	float aspect_win = (float) win_w / win_h;
 	float aspect_tex = (float) texture->w / texture->h;
@@ -438,11 +751,30 @@ bool Camera::renderTexture(
 	d.w = texture->w * scale + zoom_crop_x * 2;
 	d.h = texture->h * scale + zoom_crop_y * 2;
 
+    if (layout != nullptr) {
+        *layout = {
+            .valid = true,
+            .out_w = output_w, .out_h = output_h,
+            .tex_w = texture->w, .tex_h = texture->h,
+            .zoom = framing->zoom, .pos_x = framing->pos_x, .pos_y = framing->pos_y,
+            .dst = d
+        };
+    }
+    return renderTextureAt(renderer, texture, &d, framing, renderBorder);
+}
+
+bool Camera::renderTextureAt(
+    SDL_Renderer *renderer,
+    SDL_Texture *texture,
+    const SDL_FRect *d,
+    Framing *framing,
+    bool renderBorder) {
+
 	bool error = !SDL_RenderTextureRotated(
         renderer, 
         texture, 
         NULL, 
-        &d, 
+        d, 
         (double) framing->rotation, 
         NULL, 
         framing->mirror ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE);
@@ -468,6 +800,12 @@ bool Camera::renderTexture(
 
 bool Camera::updateCountdown(CountdownSettings *cd_set) {
     if (!countdown.active) return false;
+    if (burst.active) {
+        if (burst.shots < (int) burst_pool.size()) return false; // the countdown waits for the burst
+        // continue with the capture animation as if 0 was reached just now
+        burst.active = false;
+        countdown.start_time += SDL_GetTicks() - burst.start_time;
+    }
     
 	Uint64 time_to_next_num = (cd_set->len - countdown.position + 1) * cd_set->pace;
 	Uint64 time_curr = SDL_GetTicks() - countdown.start_time;
@@ -479,6 +817,11 @@ bool Camera::updateCountdown(CountdownSettings *cd_set) {
 		std::cout << "  --  COUNTDOWN  --  " << countdown.position;
         std::cout << " since: " << time_curr << " > " << time_to_next_num << std::endl;
 	}
+	if (countdown.position == 0 && !burst_pool.empty() && burst.shots == 0 && !burst.active) {
+		burst.active = true;
+		burst.start_time = SDL_GetTicks();
+		burst.flash_time = 0;
+	}
 	if (countdown.position < -1) {
 		countdown.active = false;
         countdown.update = true;
@@ -490,11 +833,26 @@ bool Camera::updateCountdown(CountdownSettings *cd_set) {
 }
 
 void Camera::startCountdown(CountdownSettings *cd_set) {
-    if (countdown.active) return;
+    if (countdown.active || state != CameraState::Streaming) return;
     countdown.update = true;
 	countdown.position = cd_set->len;
 	countdown.start_time = SDL_GetTicks();
 	countdown.active = true;
+	countdown.shutter_ns = 0;
+	burst = {.active = false, .shots = 0, .start_time = 0, .flash_time = 0};
+	burst_pool.resize(cd_set->burst_shots > 1 ? cd_set->burst_shots : 0);
+	capture.setPreroll(burst_pool.empty()); // a single still is picked from the pre-roll
+	if (last_frame != nullptr) {
+		// no allocations while the shots are taken
+		for (CameraFrame &shot : burst_pool) {
+			shot.pixels.reserve(last_frame->pixels.size());
+			shot.preview.reserve(last_frame->preview.size());
+		}
+	}
+	if (countdown.position == 0 && !burst_pool.empty()) { // no countdown, the burst starts right away
+		burst.active = true;
+		burst.start_time = countdown.start_time;
+	}
 	std::cout << "Started Countdown at time " << countdown.start_time << "ms." << std::endl;
 }
 
@@ -4,8 +4,13 @@
 
 #include <SDL3/SDL.h>
 #include <SDL3_ttf/SDL_ttf.h>
+#include <vector>
+#include "CameraCapture.h"
+#include "FrameStats.h"
 #include "Kbooth.h"
-#include "Printer.h"
+#include "PrintLayout.h"
+#include "PrintWorker.h"
+#include "SimpleIni.h"
 namespace Kbooth {
     
     struct CountdownState {
@@ -14,17 +19,61 @@ namespace Kbooth {
 		int position; // n
 		Uint64 start_time; // t0
         float progression; // [0.0, 1.0)  for progression between tn and t(n-1)
+        Uint64 shutter_ns; // SDL_GetTicksNS() when the still was due, 0 before
+    };
+
+    // several pictures taken at 0 of the countdown, while the countdown itself waits
+    struct BurstState {
+        bool active;
+        int shots; // taken so far
+        Uint64 start_time;
+        Uint64 flash_time; // of the last shot
+    };
+
+    enum class CameraState {
+        Closed, // nothing opened yet, or opening failed
+        WaitingForPermission,
+        Streaming,
+        Disconnected, // the device went away, reopened when it comes back
+        Denied
+    };
+
+    // on screen destination of a texture, kept until one of its inputs changes
+    struct TextureLayout {
+        bool valid;
+        int out_w, out_h;
+        int tex_w, tex_h;
+        float zoom, pos_x, pos_y;
+        SDL_FRect dst;
     };
         
     class Camera {
     private:
+        static const int STRIP_WIDTH = Printer::PRINT_WIDTH; // burst strips are composed at printer resolution
+        static const int STRIP_GAP = 16; // white border around and between the shots of a strip
+        static const Uint64 SHUTTER_WINDOW_NS = 70000000; // the still is the sharpest frame within +- this of the shutter
+
         SDL_Camera *camera;
+        CameraCapture capture; // acquires the frames of camera on its own thread
+        Uint32 frame_event_type; // pushed by capture when a new frame is ready, 0 if unavailable
+        FrameStats stats;
+        CameraState state;
+        // device and format to reopen after a hotplug
+        std::string device_name;
+        SDL_CameraSpec device_spec;
+        bool device_spec_valid;
+        int requested_format_index;
+        SDL_Texture *logo_texture; // attract screen
+        Uint64 attract_drawn_at;
+        CSimpleIniA *format_ini; // holds the probed format rankings, may be nullptr
+        const FormatTarget *format_target;
         SDL_CameraID *cameras;
         int cameras_size;
         SDL_Texture *texture;
         SDL_Texture *capture_texture;
 		SDL_Surface *capture_surface;
-		SDL_Surface *logo_image;
+		SDL_Surface *logo_image; // attract screen
+		PrintLayout print_layout; // loaded when the layout in the print settings changes
 
         TTF_Font *countdown_font;
         TTF_Font *countdown_border_font;
@@ -35,13 +84,36 @@ namespace Kbooth {
         SDL_FRect framing_bar_start;
         SDL_FRect framing_bar_end;
 
+        // render output size, only queried again after invalidateLayout()
+        int output_w, output_h;
+        bool output_size_valid;
+        int frame_aspect_x, frame_aspect_y; // aspect ratio frame and bars were computed for
+        TextureLayout feed_layout;
+
 		int image_count;
         CountdownState countdown;
+        BurstState burst;
+        // copies of the burst shots, allocated when the countdown starts and reused
+        std::vector<CameraFrame> burst_pool;
+        std::vector<PrintTile> strip_tiles; // the shots in capture_surface, empty for a single picture
+        const CameraFrame *last_frame; // shown by the last renderCameraFeed, valid until the next one
+        CameraFrame still; // sharpest pre-roll frame around the shutter, buffers reused between captures
         SDL_Color countdown_color;
         
 
 		void cleanup(); // closes all resources
-		bool renderTexture(SDL_Renderer *renderer, SDL_Texture *texture, Framing *framing, bool renderBorder);
+		void closeDevice(); // stops capturing and closes the camera, keeps everything else
+		void startStreaming();
+		void refreshCameraList();
+		void reopen(SDL_CameraID camera_id);
+		void renderAttractScreen(SDL_Renderer *renderer);
+		void renderBurst(SDL_Renderer *renderer, Settings *settings);
+		void updateOutputSize(SDL_Renderer *renderer);
+		// layout caches the destination rect, nullptr recomputes it (e.g. while animating)
+		bool renderTexture(SDL_Renderer *renderer, SDL_Texture *texture, Framing *framing, bool renderBorder,
+		                   TextureLayout *layout);
+		bool renderTextureAt(SDL_Renderer *renderer, SDL_Texture *texture, const SDL_FRect *d,
+		                     Framing *framing, bool renderBorder);
     public:
         Camera();
         ~Camera();
@@ -54,10 +126,28 @@ namespace Kbooth {
         void setFont(const char *font_file);
         void setFontColor(float *color);
 
+        // rankings of FormatProbe in ini are used when open() selects the format automatically
+        void setFormatSelection(CSimpleIniA *ini, const FormatTarget *target);
+        /**
+         * @brief Opens a camera without waiting for the permission.
+         *
+         * Capturing starts once the permission is granted, see handleEvent.
+         * Returns false if the camera could not be opened at all.
+         */
         bool open(int device, int format_index);
+        // permission and hotplug events: reopens the same device and format when it comes back
+        void handleEvent(SDL_Event *event);
+        CameraState getState();
+        // recomputes frame and bars, if the aspect ratio or the output size changed
         void setAspectRatio(SDL_Renderer *renderer, int aspect_x, int aspect_y);
+        // the render output was resized, geometry is recomputed on the next frame
+        void invalidateLayout();
+        // whether renderFrame would draw something different from the last frame
+        bool needsRedraw();
+        Uint32 getFrameEventType();
+        FrameStats *getFrameStats();
 
-		void saveAndPrintImage(Printer *printer, PrintSettings *printing);
+		void saveAndPrintImage(PrintWorker *print_worker, PrintSettings *print_set);
 
         bool renderFrame(SDL_Renderer *renderer, Settings *settings);
         void renderCountdown(SDL_Renderer *renderer);
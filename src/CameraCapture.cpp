@@ -0,0 +1,160 @@
+#include "CameraCapture.h"
+#include "Sharpness.h"
+
+#include <iostream>
+#include <string.h>
+
+using namespace Kbooth;
+
+CameraCapture::CameraCapture() :
+    camera(nullptr),
+    running(false),
+    wake_pending(false),
+    wake_event_type(0),
+    sequence(0),
+    last_timestamp_ns(0),
+    typical_interval_ns(0),
+    gaps(0),
+    preview_w(0),
+    preview_h(0),
+    preroll_enabled(false),
+    preroll_next(0) {}
+
+CameraCapture::~CameraCapture() {
+    stop();
+}
+
+void CameraCapture::start(SDL_Camera *camera, Uint32 wake_event_type) {
+    stop();
+    this->camera = camera;
+    last_timestamp_ns = 0;
+    typical_interval_ns = 0;
+    this->wake_event_type = wake_event_type;
+    wake_pending = false;
+    for (CameraFrame &frame : preroll) frame.sequence = 0; // from another camera or format
+    running = true;
+    thread = std::thread(&CameraCapture::run, this);
+}
+
+void CameraCapture::stop() {
+    running = false;
+    if (thread.joinable()) thread.join();
+    camera = nullptr;
+}
+
+const Uint8 *CameraFrame::lumaPlane() const {
+    switch (format) {
+        case SDL_PIXELFORMAT_YV12:
+        case SDL_PIXELFORMAT_IYUV:
+        case SDL_PIXELFORMAT_NV12:
+        case SDL_PIXELFORMAT_NV21:
+            return pixels.empty() ? nullptr : pixels.data(); // the luma plane comes first
+        default:
+            return nullptr;
+    }
+}
+
+size_t CameraCapture::frameSize(const SDL_Surface *frame) {
+    switch (frame->format) {
+        // planar 4:2:0, pitch is the pitch of the luma plane
+        case SDL_PIXELFORMAT_YV12:
+        case SDL_PIXELFORMAT_IYUV:
+        case SDL_PIXELFORMAT_NV12:
+        case SDL_PIXELFORMAT_NV21:
+        case SDL_PIXELFORMAT_P010:
+            return (size_t) frame->pitch * frame->h + (size_t) frame->pitch * ((frame->h + 1) / 2);
+        // compressed, pitch holds the size of the frame data
+        case SDL_PIXELFORMAT_MJPG:
+            return (size_t) frame->pitch;
+        default:
+            return (size_t) frame->pitch * frame->h;
+    }
+}
+
+void CameraCapture::run() {
+    while (running) {
+        Uint64 timestamp_ns;
+        SDL_Surface *frame = SDL_AcquireCameraFrame(camera, &timestamp_ns);
+        if (frame == nullptr) {
+            SDL_Delay(POLL_INTERVAL_MS);
+            continue;
+        }
+        Uint64 acquired_ns = SDL_GetTicksNS();
+        Uint64 interval_ns = 0;
+        if (timestamp_ns != 0 && last_timestamp_ns != 0 && timestamp_ns > last_timestamp_ns) {
+            interval_ns = timestamp_ns - last_timestamp_ns;
+            if (typical_interval_ns != 0 && interval_ns * 2 > typical_interval_ns * 3) {
+                gaps++; // the camera or driver skipped frames
+            } else {
+                typical_interval_ns = typical_interval_ns == 0 ?
+                    interval_ns : (typical_interval_ns * 7 + interval_ns) / 8;
+            }
+        }
+        last_timestamp_ns = timestamp_ns;
+        CameraFrame &slot = frames.writeBuffer();
+        size_t size = frameSize(frame);
+        if (slot.pixels.size() < size) slot.pixels.resize(size); // only grows, no allocation per frame
+        memcpy(slot.pixels.data(), frame->pixels, size);
+        slot.format = frame->format;
+        slot.colorspace = SDL_GetSurfaceColorspace(frame);
+        slot.w = frame->w;
+        slot.h = frame->h;
+        slot.pitch = frame->pitch;
+        slot.timestamp_ns = timestamp_ns;
+        slot.acquired_ns = acquired_ns;
+        slot.interval_ns = interval_ns;
+        slot.gaps = gaps;
+        SDL_ReleaseCameraFrame(camera, frame);
+        if (slot.format == SDL_PIXELFORMAT_MJPG &&
+            !decoder.decodeScaled(slot.pixels.data(), size, preview_w, preview_h,
+                                  &slot.preview, &slot.preview_w, &slot.preview_h, &slot.preview_pitch)) {
+            continue; // corrupt frame, the slot is reused for the next one
+        }
+        slot.sequence = ++sequence;
+        if (preroll_enabled) {
+            slot.sharpness = Sharpness::score(&slot, &sharpness_scratch);
+            std::lock_guard<std::mutex> lock(preroll_mutex);
+            preroll[preroll_next] = slot; // reuses the buffers of the overwritten frame
+            preroll_next = (preroll_next + 1) % PREROLL_FRAMES;
+        }
+        frames.publish();
+        if (wake_event_type != 0 && !wake_pending.exchange(true)) {
+            SDL_Event event;
+            SDL_zero(event);
+            event.type = wake_event_type;
+            SDL_PushEvent(&event);
+        }
+    }
+}
+
+void CameraCapture::setPreviewSize(int w, int h) {
+    preview_w = w;
+    preview_h = h;
+}
+
+const CameraFrame *CameraCapture::latest(bool *fresh) {
+    wake_pending = false;
+    *fresh = frames.update();
+    const CameraFrame &frame = frames.readBuffer();
+    if (frame.sequence == 0) return nullptr;
+    return &frame;
+}
+
+void CameraCapture::setPreroll(bool enabled) {
+    preroll_enabled = enabled;
+}
+
+bool CameraCapture::sharpest(Uint64 from_ns, Uint64 to_ns, CameraFrame *out) {
+    std::lock_guard<std::mutex> lock(preroll_mutex);
+    int best = -1;
+    for (int i = 0; i < PREROLL_FRAMES; i++) {
+        const CameraFrame &frame = preroll[i];
+        if (frame.sequence == 0) continue;
+        Uint64 taken_ns = frame.timestamp_ns != 0 ? frame.timestamp_ns : frame.acquired_ns;
+        if (taken_ns < from_ns || taken_ns > to_ns) continue;
+        if (best < 0 || frame.sharpness > preroll[best].sharpness) best = i;
+    }
+    if (best < 0) return false;
+    *out = preroll[best];
+    return true;
+}
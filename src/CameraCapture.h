@@ -0,0 +1,109 @@
+#ifndef KB_CAMERA_CAPTURE_H
+#define KB_CAMERA_CAPTURE_H
+
+#include <SDL3/SDL.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "MjpegDecoder.h"
+#include "TripleBuffer.h"
+
+namespace Kbooth {
+
+    // a copy of one camera frame, the pixel buffer is reused between frames
+    struct CameraFrame {
+        std::vector<unsigned char> pixels;
+        SDL_PixelFormat format;
+        SDL_Colorspace colorspace;
+        int w;
+        int h;
+        int pitch; // size of the frame data for MJPG
+        Uint64 timestamp_ns; // sensor timestamp, SDL_GetTicksNS() clock, 0 if unknown
+        Uint64 acquired_ns; // SDL_GetTicksNS() when the capture thread got the frame
+        Uint64 interval_ns; // to the timestamp of the previous frame, 0 if unknown
+        Uint64 gaps; // so far, intervals of more than 1.5 typical frame intervals
+        Uint64 sequence; // 0 until the slot got its first frame
+        float sharpness; // Sharpness::score, only computed for pre-roll frames
+
+        // MJPG only: RGBX32 copy decoded at reduced scale for the preview,
+        // pixels keeps the compressed frame for a full decode on capture
+        std::vector<unsigned char> preview;
+        int preview_w;
+        int preview_h;
+        int preview_pitch;
+
+        // luma plane of planar 8 bit YUV formats, pitch bytes per row, nullptr for other formats
+        const Uint8 *lumaPlane() const;
+    };
+
+    /**
+     * Acquires camera frames on its own thread as soon as they arrive and
+     * publishes copies through a triple buffer, so a slow render frame
+     * never makes the camera drop frames.
+     */
+    class CameraCapture {
+    private:
+        static const Uint32 POLL_INTERVAL_MS = 2;
+        static const int PREROLL_FRAMES = 6;
+
+        SDL_Camera *camera;
+        std::thread thread;
+        std::atomic<bool> running;
+        std::atomic<bool> wake_pending; // a wake event is queued and no frame was taken since
+        Uint32 wake_event_type;
+        TripleBuffer<CameraFrame> frames;
+        Uint64 sequence;
+        Uint64 last_timestamp_ns;
+        Uint64 typical_interval_ns; // running average without the gaps
+        Uint64 gaps;
+        MjpegDecoder decoder;
+        std::atomic<int> preview_w, preview_h; // smallest useful preview decode size
+        // the last frames with their sharpness, kept while a capture is coming up
+        std::atomic<bool> preroll_enabled;
+        std::mutex preroll_mutex;
+        CameraFrame preroll[PREROLL_FRAMES];
+        int preroll_next;
+        std::vector<unsigned char> sharpness_scratch;
+
+        void run();
+    public:
+        static size_t frameSize(const SDL_Surface *frame);
+
+        CameraCapture();
+        ~CameraCapture();
+
+        /**
+         * @brief Starts capturing from camera, which must stay open until stop() returned.
+         *
+         * If wake_event_type is not 0, an event of that type is pushed when a
+         * new frame is ready, so an idle render loop can wait for events.
+         */
+        void start(SDL_Camera *camera, Uint32 wake_event_type);
+        void stop();
+
+        /**
+         * @brief Returns the newest frame without blocking, nullptr before the first one.
+         *
+         * fresh is set if the frame wasn't returned before. The frame stays
+         * valid until the next call; only the render thread may call this.
+         */
+        const CameraFrame *latest(bool *fresh);
+        bool hasNewFrame() const { return frames.hasFresh(); }
+        // MJPG previews are decoded at the smallest scale that still covers w x h
+        void setPreviewSize(int w, int h);
+
+        // keeps the last PREROLL_FRAMES frames and scores their sharpness on the capture thread
+        void setPreroll(bool enabled);
+        /**
+         * @brief Copies the sharpest pre-roll frame taken between from_ns and
+         * to_ns (sensor timestamps, SDL_GetTicksNS() clock) into out.
+         *
+         * Only takes the lock for the copy, the frames were scored when they
+         * arrived. Returns false if no frame falls into the window.
+         */
+        bool sharpest(Uint64 from_ns, Uint64 to_ns, CameraFrame *out);
+    };
+}
+
+#endif // KB_CAMERA_CAPTURE_H
@@ -0,0 +1,92 @@
+#include "EscPosJob.h"
+#include "EscPosCommands.h"
+
+#include <iostream>
+#include <string.h>
+
+using namespace Kbooth;
+
+EscPosJob::EscPosJob() : flushed(0), overflowed(false) {}
+
+void EscPosJob::clear() {
+    arena.clear(); // keeps the capacity
+    flushed = 0;
+    overflowed = false;
+}
+
+void EscPosJob::reserve(size_t bytes) {
+    if (flushed > 0) return; // flushed data must not move
+    arena.reserve(bytes);
+}
+
+size_t EscPosJob::rasterSize(int width, int height) {
+    return RASTER_HEADER_SIZE + (size_t) ((width + 7) / 8) * height;
+}
+
+unsigned char *EscPosJob::grow(size_t n) {
+    if (overflowed) return nullptr;
+    // reallocating would move the bytes the transport is still sending
+    if (flushed > 0 && arena.size() + n > arena.capacity()) {
+        std::cerr << "ERROR: print job outgrew its reserve of " << arena.capacity() << " bytes" << std::endl;
+        overflowed = true;
+        return nullptr;
+    }
+    size_t offset = arena.size();
+    arena.resize(offset + n);
+    return arena.data() + offset;
+}
+
+EscPosJob &EscPosJob::append(const unsigned char *bytes, size_t n) {
+    unsigned char *p = grow(n);
+    if (p != nullptr) memcpy(p, bytes, n);
+    return *this;
+}
+
+EscPosJob &EscPosJob::command(const std::vector<unsigned char> &cmd) {
+    return append(cmd.data(), cmd.size());
+}
+
+EscPosJob &EscPosJob::init() {
+    return command(ESC_Init);
+}
+
+EscPosJob &EscPosJob::lineSpacing(unsigned char n) {
+    unsigned char *p = grow(3);
+    if (p == nullptr) return *this;
+    p[0] = 0x1b; p[1] = 0x33; p[2] = n;
+    return *this;
+}
+
+EscPosJob &EscPosJob::defaultLineSpacing() {
+    return command(ESC_Two);
+}
+
+EscPosJob &EscPosJob::lineFeed() {
+    return command(ESC_LF);
+}
+
+EscPosJob &EscPosJob::feed(unsigned char n) {
+    unsigned char *p = grow(3);
+    if (p == nullptr) return *this;
+    p[0] = 0x1b; p[1] = 0x4a; p[2] = n;
+    return *this;
+}
+
+EscPosJob &EscPosJob::cut(unsigned char feed) {
+    unsigned char *p = grow(4);
+    if (p == nullptr) return *this;
+    p[0] = 0x1d; p[1] = 0x56; p[2] = 0x42; p[3] = feed;
+    return *this;
+}
+
+unsigned char *EscPosJob::raster(int width, int height) {
+    int width_bytes = (width + 7) / 8;
+    unsigned char *header = grow(rasterSize(width, height));
+    if (header == nullptr) return nullptr;
+    header[0] = 0x1d; header[1] = 0x76; header[2] = 0x30; header[3] = 0x00;
+    header[4] = (unsigned char) (width_bytes % 256);
+    header[5] = (unsigned char) (width_bytes / 256);
+    header[6] = (unsigned char) (height % 256);
+    header[7] = (unsigned char) (height / 256);
+    return header + RASTER_HEADER_SIZE;
+}
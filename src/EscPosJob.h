@@ -0,0 +1,64 @@
+#ifndef KB_ESC_POS_JOB_H
+#define KB_ESC_POS_JOB_H
+
+#include <stddef.h>
+#include <vector>
+
+namespace Kbooth {
+
+    /**
+     * Builds a whole print job (commands and raster blocks) in one byte
+     * arena, so it can be sent with a single transfer or a few large ones.
+     * The arena keeps its capacity between jobs: after the first print,
+     * building a job of the same size does not allocate.
+     *
+     * Once part of the job has been flushed to the transport it must not
+     * move anymore, so reserve() the full size before the first flush.
+     * Growing past the reserve after a flush fails the job instead: nothing
+     * is appended anymore and failed() stays true until clear().
+     */
+    class EscPosJob {
+    private:
+        std::vector<unsigned char> arena;
+        size_t flushed; // bytes already handed to the transport
+        bool overflowed; // something did not fit the reserve after a flush
+
+        unsigned char *grow(size_t n);
+        EscPosJob &append(const unsigned char *bytes, size_t n);
+    public:
+        static const size_t RASTER_HEADER_SIZE = 8;
+
+        EscPosJob();
+
+        void clear();
+        void reserve(size_t bytes);
+        // bytes a GS v 0 block of the given size takes
+        static size_t rasterSize(int width, int height);
+
+        EscPosJob &command(const std::vector<unsigned char> &cmd);
+        EscPosJob &init();                         // ESC @
+        EscPosJob &lineSpacing(unsigned char n);   // ESC 3 n
+        EscPosJob &defaultLineSpacing();           // ESC 2
+        EscPosJob &lineFeed();                     // LF
+        EscPosJob &feed(unsigned char n);          // ESC J n
+        EscPosJob &cut(unsigned char feed);        // GS V 66 n, feed and partial cut
+
+        // appends a GS v 0 header for width x height dots and returns the
+        // ceil(width / 8) * height bytes reserved for the packed rows,
+        // nullptr when the job failed
+        unsigned char *raster(int width, int height);
+        // appends an already packed GS v 0 block
+        EscPosJob &rasterBlock(const unsigned char *block, size_t n) { return append(block, n); }
+
+        const unsigned char *data() const { return arena.data(); }
+        size_t size() const { return arena.size(); }
+        bool failed() const { return overflowed; }
+
+        // the part of the job that has not been flushed yet
+        const unsigned char *unflushed() const { return arena.data() + flushed; }
+        size_t unflushedSize() const { return arena.size() - flushed; }
+        void markFlushed() { flushed = arena.size(); }
+    };
+}
+
+#endif // KB_ESC_POS_JOB_H
@@ -0,0 +1,177 @@
+#include "FormatProbe.h"
+#include "CameraCapture.h"
+#include "MjpegDecoder.h"
+
+#include <algorithm>
+#include <ctime>
+#include <iostream>
+#include <math.h>
+#include <sstream>
+#include <stdio.h>
+
+using namespace Kbooth;
+
+std::string FormatProbe::specKey(const SDL_CameraSpec *spec) {
+    std::stringstream key;
+    key << spec->width << "x" << spec->height << " " << SDL_GetPixelFormatName(spec->format)
+        << " " << spec->framerate_numerator << "/" << spec->framerate_denominator;
+    return key.str();
+}
+
+std::string FormatProbe::iniSection(const char *camera_name) {
+    return std::string("camera ") + (camera_name != nullptr ? camera_name : "unknown");
+}
+
+bool FormatProbe::probeSpec(SDL_CameraID camera_id, const SDL_CameraSpec *spec, Uint32 duration_ms,
+                            FormatProbeResult *result) {
+    SDL_Camera *camera = SDL_OpenCamera(camera_id, spec);
+    if (camera == nullptr) return false;
+    Uint64 opened_at = SDL_GetTicks();
+    int permission = 0;
+    while (permission == 0 && SDL_GetTicks() - opened_at < PERMISSION_TIMEOUT_MS) {
+        SDL_Delay(10);
+        permission = SDL_GetCameraPermissionState(camera);
+    }
+    if (permission != 1) {
+        SDL_CloseCamera(camera);
+        return false;
+    }
+
+    // do the per frame work of CameraCapture, so its cpu time is included
+    MjpegDecoder decoder;
+    std::vector<unsigned char> copy, preview;
+    int preview_w, preview_h, preview_pitch;
+
+    Uint64 measure_from = SDL_GetTicks() + WARMUP_MS;
+    Uint64 measure_until = measure_from + duration_ms;
+    bool measuring = false;
+    std::clock_t cpu_start = 0;
+    Uint64 first_ns = 0, last_ns = 0;
+    int frames = 0;
+    double interval_sum = 0.0, interval_square_sum = 0.0;
+    while (SDL_GetTicks() < measure_until) {
+        Uint64 timestamp_ns;
+        SDL_Surface *frame = SDL_AcquireCameraFrame(camera, &timestamp_ns);
+        if (frame == nullptr) {
+            SDL_Delay(1);
+            continue;
+        }
+        if (!measuring && SDL_GetTicks() >= measure_from) {
+            measuring = true;
+            cpu_start = std::clock();
+        }
+        if (measuring) {
+            size_t size = CameraCapture::frameSize(frame);
+            if (copy.size() < size) copy.resize(size);
+            memcpy(copy.data(), frame->pixels, size);
+            if (frame->format == SDL_PIXELFORMAT_MJPG) {
+                decoder.decodeScaled(copy.data(), size, frame->w / 2, frame->h / 2,
+                                     &preview, &preview_w, &preview_h, &preview_pitch);
+            }
+            if (timestamp_ns == 0) timestamp_ns = SDL_GetTicksNS();
+            if (frames > 0) {
+                double interval_ms = (double) (timestamp_ns - last_ns) / 1e6;
+                interval_sum += interval_ms;
+                interval_square_sum += interval_ms * interval_ms;
+            } else {
+                first_ns = timestamp_ns;
+            }
+            last_ns = timestamp_ns;
+            frames++;
+        }
+        SDL_ReleaseCameraFrame(camera, frame);
+    }
+    std::clock_t cpu_end = std::clock();
+    SDL_CloseCamera(camera);
+    if (frames < 2 || last_ns <= first_ns) return false;
+
+    int intervals = frames - 1;
+    double mean = interval_sum / intervals;
+    double variance = interval_square_sum / intervals - mean * mean;
+    result->key = specKey(spec);
+    result->fps = (float) (intervals / ((double) (last_ns - first_ns) / 1e9));
+    result->jitter_ms = (float) sqrt(variance > 0.0 ? variance : 0.0);
+    result->cpu_ms = (float) ((double) (cpu_end - cpu_start) * 1000.0 / CLOCKS_PER_SEC / frames);
+    return true;
+}
+
+std::vector<FormatProbeResult> FormatProbe::run(SDL_CameraID camera_id, Uint32 duration_ms) {
+    std::vector<FormatProbeResult> results;
+    int count;
+    SDL_CameraSpec **specs = SDL_GetCameraSupportedFormats(camera_id, &count);
+    if (specs == nullptr) return results;
+    for (int i = 0; i < count; i++) {
+        FormatProbeResult result;
+        std::cout << "Probing format " << i + 1 << "/" << count << ": " << specKey(specs[i]) << std::flush;
+        if (!probeSpec(camera_id, specs[i], duration_ms, &result)) {
+            std::cout << " -> no frames" << std::endl;
+            continue;
+        }
+        std::cout << " -> " << result.fps << " fps, jitter " << result.jitter_ms
+                  << " ms, cpu " << result.cpu_ms << " ms/frame" << std::endl;
+        results.push_back(result);
+    }
+    SDL_free(specs);
+    return results;
+}
+
+bool FormatProbe::meetsTarget(const FormatProbeResult &result, const FormatTarget *target) {
+    int width = 0, height = 0;
+    if (sscanf(result.key.c_str(), "%dx%d", &width, &height) != 2) return false;
+    // 5% slack, cameras deliver 29.97 for 30
+    return result.fps >= target->fps * 0.95f && width >= target->width && height >= target->height;
+}
+
+void FormatProbe::rank(std::vector<FormatProbeResult> *results, const FormatTarget *target) {
+    std::stable_sort(results->begin(), results->end(),
+        [target](const FormatProbeResult &a, const FormatProbeResult &b) {
+            bool a_meets = meetsTarget(a, target), b_meets = meetsTarget(b, target);
+            if (a_meets != b_meets) return a_meets;
+            if (!a_meets) return a.fps > b.fps;
+            if (a.cpu_ms != b.cpu_ms) return a.cpu_ms < b.cpu_ms;
+            return a.jitter_ms < b.jitter_ms;
+        });
+}
+
+void FormatProbe::save(CSimpleIniA *ini, const char *camera_name, const std::vector<FormatProbeResult> &ranked) {
+    std::string section = iniSection(camera_name);
+    ini->Delete(section.c_str(), NULL);
+    for (size_t i = 0; i < ranked.size(); i++) {
+        // Format1 = 1280x720 SDL_PIXELFORMAT_NV12 30/1 | 29.97 0.80 1.90
+        std::stringstream value;
+        value << ranked[i].key << " | " << ranked[i].fps << " " << ranked[i].jitter_ms << " " << ranked[i].cpu_ms;
+        std::string name = "Format" + std::to_string(i + 1);
+        ini->SetValue(section.c_str(), name.c_str(), value.str().c_str());
+    }
+}
+
+std::vector<FormatProbeResult> FormatProbe::load(CSimpleIniA *ini, const char *camera_name) {
+    std::vector<FormatProbeResult> ranked;
+    std::string section = iniSection(camera_name);
+    for (int i = 1; ; i++) {
+        std::string name = "Format" + std::to_string(i);
+        const char *value = ini->GetValue(section.c_str(), name.c_str(), nullptr);
+        if (value == nullptr) break;
+        std::string line = value;
+        size_t separator = line.find(" | ");
+        if (separator == std::string::npos) continue;
+        FormatProbeResult result;
+        result.key = line.substr(0, separator);
+        if (sscanf(line.c_str() + separator + 3, "%f %f %f", &result.fps, &result.jitter_ms, &result.cpu_ms) != 3) {
+            continue;
+        }
+        ranked.push_back(result);
+    }
+    return ranked;
+}
+
+int FormatProbe::select(const std::vector<FormatProbeResult> &ranked, SDL_CameraSpec **specs, int count,
+                        const FormatTarget *target) {
+    for (const FormatProbeResult &result : ranked) {
+        if (!meetsTarget(result, target)) continue;
+        for (int i = 0; i < count; i++) {
+            if (specKey(specs[i]) == result.key) return i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,50 @@
+#ifndef KB_FORMAT_PROBE_H
+#define KB_FORMAT_PROBE_H
+
+#include <SDL3/SDL.h>
+#include <string>
+#include <vector>
+#include "Kbooth.h"
+#include "SimpleIni.h"
+
+namespace Kbooth {
+
+    struct FormatProbeResult {
+        std::string key; // spec as in specKey(), stable across format index shifts
+        float fps; // delivered frames per second
+        float jitter_ms; // standard deviation of the frame interval
+        float cpu_ms; // process cpu time per frame: driver, copy and mjpeg preview decode
+    };
+
+    /**
+     * Opens every format of a camera in turn and measures what it really
+     * delivers. Ranked results are stored per camera name in the ini, so
+     * automatic format selection does not depend on format indices.
+     */
+    class FormatProbe {
+    private:
+        static const Uint32 WARMUP_MS = 700; // exposure and frame rate settle after opening
+        static const Uint32 PERMISSION_TIMEOUT_MS = 5000;
+
+        static bool meetsTarget(const FormatProbeResult &result, const FormatTarget *target);
+        static bool probeSpec(SDL_CameraID camera_id, const SDL_CameraSpec *spec, Uint32 duration_ms,
+                              FormatProbeResult *result);
+    public:
+        static std::string specKey(const SDL_CameraSpec *spec);
+        static std::string iniSection(const char *camera_name);
+
+        // measures every format of camera_id for duration_ms each, in the order of SDL
+        static std::vector<FormatProbeResult> run(SDL_CameraID camera_id, Uint32 duration_ms);
+        // formats that meet target first by cpu time, the rest by delivered fps
+        static void rank(std::vector<FormatProbeResult> *results, const FormatTarget *target);
+
+        static void save(CSimpleIniA *ini, const char *camera_name, const std::vector<FormatProbeResult> &ranked);
+        static std::vector<FormatProbeResult> load(CSimpleIniA *ini, const char *camera_name);
+
+        // index into specs of the best ranked format that meets target, -1 if there is none
+        static int select(const std::vector<FormatProbeResult> &ranked, SDL_CameraSpec **specs, int count,
+                          const FormatTarget *target);
+    };
+}
+
+#endif // KB_FORMAT_PROBE_H
@@ -0,0 +1,88 @@
+#include "FrameStats.h"
+
+#include <algorithm>
+
+using namespace Kbooth;
+
+FrameStats::FrameStats() {
+    reset();
+}
+
+void FrameStats::reset() {
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        rings[i].count = 0;
+        rings[i].next = 0;
+    }
+    displayed = 0;
+    dropped = 0;
+    duplicated = 0;
+    camera_gaps = 0;
+    last_sequence = 0;
+    upload_pending = false;
+    pending_sensor_ns = 0;
+    pending_upload_ns = 0;
+}
+
+const char *FrameStats::stageName(Stage stage) {
+    switch (stage) {
+        case SENSOR_TO_ACQUIRE: return "sensor > acquire";
+        case ACQUIRE_TO_UPLOAD: return "acquire > upload";
+        case UPLOAD_TO_PRESENT: return "upload > present";
+        case GLASS_TO_GLASS:    return "glass to glass";
+        case FRAME_INTERVAL:    return "frame interval";
+        default: return "";
+    }
+}
+
+void FrameStats::add(Stage stage, Uint64 from_ns, Uint64 to_ns) {
+    // a camera without timestamps reports 0
+    if (from_ns == 0 || to_ns < from_ns) return;
+    addSample(stage, (float) (to_ns - from_ns) / 1e6f);
+}
+
+void FrameStats::addSample(Stage stage, float ms) {
+    Ring &ring = rings[stage];
+    ring.samples[ring.next] = ms;
+    ring.next = (ring.next + 1) % WINDOW;
+    if (ring.count < WINDOW) ring.count++;
+}
+
+void FrameStats::frameUploaded(const CameraFrame *frame, Uint64 upload_ns) {
+    if (last_sequence != 0 && frame->sequence > last_sequence + 1) {
+        dropped += frame->sequence - last_sequence - 1;
+    }
+    if (frame->sequence <= last_sequence) return; // already counted
+    last_sequence = frame->sequence;
+
+    add(SENSOR_TO_ACQUIRE, frame->timestamp_ns, frame->acquired_ns);
+    add(ACQUIRE_TO_UPLOAD, frame->acquired_ns, upload_ns);
+    if (frame->interval_ns != 0) addSample(FRAME_INTERVAL, (float) frame->interval_ns / 1e6f);
+    camera_gaps = frame->gaps;
+    upload_pending = true;
+    pending_sensor_ns = frame->timestamp_ns;
+    pending_upload_ns = upload_ns;
+}
+
+void FrameStats::framePresented(Uint64 present_ns) {
+    if (!upload_pending) {
+        if (last_sequence != 0) duplicated++;
+        return;
+    }
+    add(UPLOAD_TO_PRESENT, pending_upload_ns, present_ns);
+    add(GLASS_TO_GLASS, pending_sensor_ns, present_ns);
+    upload_pending = false;
+    displayed++;
+}
+
+bool FrameStats::percentiles(Stage stage, float *p50, float *p95, float *p99) {
+    const Ring &ring = rings[stage];
+    if (ring.count == 0) return false;
+    float sorted[WINDOW];
+    std::copy(ring.samples, ring.samples + ring.count, sorted);
+    std::sort(sorted, sorted + ring.count);
+    int last = ring.count - 1;
+    *p50 = sorted[last * 50 / 100];
+    *p95 = sorted[last * 95 / 100];
+    *p99 = sorted[last * 99 / 100];
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef KB_FRAME_STATS_H
+#define KB_FRAME_STATS_H
+
+#include <SDL3/SDL.h>
+#include "CameraCapture.h"
+
+namespace Kbooth {
+
+    /**
+     * Latency and frame drop instrumentation of the camera pipeline:
+     * sensor timestamp -> acquire -> texture upload -> present.
+     *
+     * Latencies are kept for the last WINDOW displayed frames, so the
+     * percentiles follow changes of format or load. Only the render
+     * thread may use it.
+     */
+    class FrameStats {
+    public:
+        enum Stage {
+            SENSOR_TO_ACQUIRE,
+            ACQUIRE_TO_UPLOAD, // includes mjpeg decode and waiting for the render loop
+            UPLOAD_TO_PRESENT,
+            GLASS_TO_GLASS, // sensor to present
+            FRAME_INTERVAL, // between sensor timestamps of consecutive captured frames
+            STAGE_COUNT
+        };
+        static const int WINDOW = 240;
+
+        FrameStats();
+        void reset();
+
+        // a fresh camera frame was uploaded to the preview texture at upload_ns
+        void frameUploaded(const CameraFrame *frame, Uint64 upload_ns);
+        // the render loop presented at present_ns
+        void framePresented(Uint64 present_ns);
+
+        // rolling percentiles in milliseconds, false if there are no samples yet
+        bool percentiles(Stage stage, float *p50, float *p95, float *p99);
+        static const char *stageName(Stage stage);
+
+        Uint64 displayed; // camera frames that made it to the screen
+        Uint64 dropped; // captured frames replaced before they could be shown
+        Uint64 duplicated; // presents that showed an already presented frame again
+        Uint64 camera_gaps; // frames the camera itself skipped, see CameraFrame::gaps
+    private:
+        struct Ring {
+            float samples[WINDOW];
+            int count;
+            int next;
+        };
+        Ring rings[STAGE_COUNT];
+
+        Uint64 last_sequence;
+        bool upload_pending; // uploaded, but not presented yet
+        Uint64 pending_sensor_ns;
+        Uint64 pending_upload_ns;
+
+        void add(Stage stage, Uint64 from_ns, Uint64 to_ns);
+        void addSample(Stage stage, float ms);
+    };
+}
+
+#endif // KB_FRAME_STATS_H
@@ -0,0 +1,196 @@
+#include "ImageOps.h"
+#include "MjpegDecoder.h"
+
+#include <iostream>
+#include <math.h>
+
+using namespace Kbooth;
+
+SDL_Surface *ImageOps::convertFrame(const CameraFrame *frame) {
+    if (frame == nullptr || frame->pixels.empty()) return nullptr;
+    if (frame->format == SDL_PIXELFORMAT_MJPG) {
+        // only the captured frame is decoded at full resolution
+        MjpegDecoder decoder;
+        return decoder.decode(frame->pixels.data(), (size_t) frame->pitch);
+    }
+    SDL_Surface *surface = SDL_CreateSurface(frame->w, frame->h, SDL_PIXELFORMAT_RGBA32);
+    if (surface == nullptr) {
+        std::cerr << "ERROR: could not create frame surface: " << SDL_GetError() << std::endl;
+        return nullptr;
+    }
+    // also handles the YUV formats
+    if (!SDL_ConvertPixelsAndColorspace(frame->w, frame->h,
+                                        frame->format, frame->colorspace, 0, frame->pixels.data(), frame->pitch,
+                                        SDL_PIXELFORMAT_RGBA32, SDL_COLORSPACE_SRGB, 0, surface->pixels, surface->pitch)) {
+        SDL_DestroySurface(surface);
+        return nullptr;
+    }
+    return surface;
+}
+
+SDL_Surface *ImageOps::resampleFramed(SDL_Surface *src, const Framing *framing) {
+    if (src == nullptr || src->format != SDL_PIXELFORMAT_RGBA32) return nullptr;
+    return resample((const unsigned char*) src->pixels, src->w, src->h, src->pitch, 4, nullptr, framing);
+}
+
+SDL_Surface *ImageOps::resampleLumaFramed(const CameraFrame *frame, const Framing *framing) {
+    const Uint8 *luma = frame != nullptr ? frame->lumaPlane() : nullptr;
+    if (luma == nullptr) return nullptr;
+    // video range luma spans 16..235, unless the camera says it is full range
+    unsigned char lut[256];
+    bool full_range = SDL_COLORSPACERANGE(frame->colorspace) == SDL_COLOR_RANGE_FULL;
+    for (int i = 0; i < 256; i++) {
+        int value = full_range ? i : ((i - 16) * 255 + 109) / 219;
+        lut[i] = (unsigned char) (value < 0 ? 0 : value > 255 ? 255 : value);
+    }
+    return resample(luma, frame->w, frame->h, frame->pitch, 1, lut, framing);
+}
+
+SDL_Surface *ImageOps::resample(const unsigned char *src_pixels, int src_w, int src_h, int src_pitch,
+                                int channels, const unsigned char *lut, const Framing *framing) {
+    const float zoom = framing->zoom;
+
+    // the same geometry as Camera::renderTexture and setAspectRatio,
+    // with src itself as the output, so the texture scale is 1
+    float frame_x, frame_y, frame_w, frame_h;
+    float aspect_src = (float) src_w / src_h;
+    float aspect_frame = (float) framing->aspect_x / framing->aspect_y;
+    if (aspect_frame > aspect_src) {
+        frame_w = (float) src_w;
+        frame_h = src_w / aspect_frame;
+    } else {
+        frame_w = src_h * aspect_frame;
+        frame_h = (float) src_h;
+    }
+    frame_x = (src_w - frame_w) / 2.0f;
+    frame_y = (src_h - frame_h) / 2.0f;
+
+    float zoom_crop_x = src_w / 2.0f * (zoom - 1);
+    float zoom_crop_y = src_h / 2.0f * (zoom - 1);
+    float d_x = -((framing->pos_x + 1) * zoom_crop_x);
+    float d_y = -((framing->pos_y + 1) * zoom_crop_y);
+    float d_w = src_w + zoom_crop_x * 2;
+    float d_h = src_h + zoom_crop_y * 2;
+
+    // zooming in keeps one output pixel per source pixel, zooming out does not upscale
+    float density = zoom > 1.0f ? 1.0f / zoom : 1.0f;
+    int out_w = (int) lroundf(frame_w * density);
+    int out_h = (int) lroundf(frame_h * density);
+    if (out_w < 1) out_w = 1;
+    if (out_h < 1) out_h = 1;
+
+    SDL_Surface *out = SDL_CreateSurface(out_w, out_h, SDL_PIXELFORMAT_RGBA32);
+    if (out == nullptr) {
+        std::cerr << "ERROR: could not create capture surface: " << SDL_GetError() << std::endl;
+        return nullptr;
+    }
+
+    // inverse of SDL_RenderTextureRotated: rotate back around the center of d
+    // (clockwise in degrees), undo the horizontal flip, then scale into src
+    float angle = framing->rotation * (float) M_PI / 180.0f;
+    float cos_a = cosf(angle), sin_a = sinf(angle);
+    float center_x = d_x + d_w / 2.0f, center_y = d_y + d_h / 2.0f;
+    float scale_x = src_w / d_w, scale_y = src_h / d_h;
+    auto map = [&](float px, float py, float *sx, float *sy) {
+        float qx = px - center_x, qy = py - center_y;
+        float lx = qx * cos_a + qy * sin_a + d_w / 2.0f;
+        float ly = -qx * sin_a + qy * cos_a + d_h / 2.0f;
+        *sx = lx * scale_x;
+        *sy = ly * scale_y;
+        if (framing->mirror) *sx = src_w - *sx;
+    };
+    float step_x = frame_w / out_w, step_y = frame_h / out_h;
+
+    for (int v = 0; v < out_h; v++) {
+        // the mapping is affine, so walk each row with a constant step
+        float py = frame_y + (v + 0.5f) * step_y;
+        float sx, sy, sx_next, sy_next;
+        map(frame_x + 0.5f * step_x, py, &sx, &sy);
+        map(frame_x + 1.5f * step_x, py, &sx_next, &sy_next);
+        float dsx = sx_next - sx, dsy = sy_next - sy;
+        sx -= 0.5f; // pixel centers
+        sy -= 0.5f;
+
+        unsigned char *dst = (unsigned char*) out->pixels + (size_t) v * out->pitch;
+        for (int u = 0; u < out_w; u++, sx += dsx, sy += dsy, dst += 4) {
+            int x0 = (int) floorf(sx), y0 = (int) floorf(sy);
+            if (x0 < -1 || y0 < -1 || x0 >= src_w || y0 >= src_h) {
+                dst[0] = dst[1] = dst[2] = 0;
+                dst[3] = 255;
+                continue;
+            }
+            // 8 bit bilinear weights, edges are clamped
+            int wx = (int) ((sx - x0) * 256.0f), wy = (int) ((sy - y0) * 256.0f);
+            int xa = x0 < 0 ? 0 : x0, xb = x0 + 1 >= src_w ? src_w - 1 : x0 + 1;
+            int ya = y0 < 0 ? 0 : y0, yb = y0 + 1 >= src_h ? src_h - 1 : y0 + 1;
+            const unsigned char *row_a = src_pixels + (size_t) ya * src_pitch;
+            const unsigned char *row_b = src_pixels + (size_t) yb * src_pitch;
+            const unsigned char *p00 = row_a + xa * channels, *p01 = row_a + xb * channels;
+            const unsigned char *p10 = row_b + xa * channels, *p11 = row_b + xb * channels;
+            if (channels == 1) { // gray, replicated to rgb
+                int top = p00[0] * (256 - wx) + p01[0] * wx;
+                int bottom = p10[0] * (256 - wx) + p11[0] * wx;
+                dst[0] = dst[1] = dst[2] = lut[(top * (256 - wy) + bottom * wy + 32768) >> 16];
+            } else {
+                for (int c = 0; c < 3; c++) {
+                    int top = p00[c] * (256 - wx) + p01[c] * wx;
+                    int bottom = p10[c] * (256 - wx) + p11[c] * wx;
+                    dst[c] = (unsigned char) ((top * (256 - wy) + bottom * wy + 32768) >> 16);
+                }
+            }
+            dst[3] = 255;
+        }
+    }
+    return out;
+}
+
+SDL_Surface *ImageOps::captureFramed(const CameraFrame *frame, const Framing *framing, bool gray) {
+    if (gray) {
+        SDL_Surface *out = resampleLumaFramed(frame, framing);
+        if (out != nullptr) return out;
+    }
+    SDL_Surface *converted = convertFrame(frame);
+    if (converted == nullptr) return nullptr;
+    SDL_Surface *out = resampleFramed(converted, framing);
+    SDL_DestroySurface(converted);
+    return out;
+}
+
+SDL_Surface *ImageOps::composeStrip(const CameraFrame *frames, int count, const Framing *framing, bool gray,
+                                    int width, int gap, std::vector<PrintTile> *tiles) {
+    tiles->clear();
+    std::vector<SDL_Surface*> shots;
+    for (int i = 0; i < count; i++) {
+        SDL_Surface *shot = captureFramed(&frames[i], framing, gray);
+        if (shot != nullptr) shots.push_back(shot);
+    }
+    SDL_Surface *strip = nullptr;
+    int shot_w = width - 2 * gap;
+    if (!shots.empty() && shot_w > 0) {
+        int height = gap;
+        for (SDL_Surface *shot : shots) {
+            int shot_h = (int) lroundf((float) shot->h * shot_w / shot->w);
+            tiles->push_back({.rows = gap + shot_h, .shot_x = gap, .shot_y = gap, .shot_w = shot_w, .shot_h = shot_h});
+            height += gap + shot_h;
+        }
+        tiles->back().rows += gap;
+        strip = SDL_CreateSurface(width, height, SDL_PIXELFORMAT_RGBA32);
+        if (strip == nullptr) {
+            std::cerr << "ERROR: could not create strip surface: " << SDL_GetError() << std::endl;
+        }
+    }
+    if (strip != nullptr) {
+        SDL_FillSurfaceRect(strip, NULL, SDL_MapSurfaceRGB(strip, 255, 255, 255));
+        int y = 0;
+        for (size_t i = 0; i < shots.size(); i++) {
+            const PrintTile &tile = (*tiles)[i];
+            SDL_Rect dst = {.x = tile.shot_x, .y = y + tile.shot_y, .w = tile.shot_w, .h = tile.shot_h};
+            SDL_BlitSurfaceScaled(shots[i], NULL, strip, &dst, SDL_SCALEMODE_LINEAR);
+            y += tile.rows;
+        }
+    } else {
+        tiles->clear();
+    }
+    for (SDL_Surface *shot : shots) SDL_DestroySurface(shot);
+    return strip;
+}
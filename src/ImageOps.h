@@ -0,0 +1,61 @@
+#ifndef KB_IMAGE_OPS_H
+#define KB_IMAGE_OPS_H
+
+#include <SDL3/SDL.h>
+#include <vector>
+#include "CameraCapture.h"
+#include "Kbooth.h"
+
+namespace Kbooth {
+
+    /**
+     * CPU image operations on captured frames, independent of the renderer.
+     */
+    struct ImageOps {
+    private:
+        // resamples 4 channel rgba or 1 channel gray (mapped through lut) to RGBA32
+        static SDL_Surface *resample(const unsigned char *src_pixels, int src_w, int src_h, int src_pitch,
+                                     int channels, const unsigned char *lut, const Framing *framing);
+    public:
+        // converts a raw camera frame (MJPG at full resolution) to an RGBA32 surface, nullptr if the format is not supported
+        static SDL_Surface *convertFrame(const CameraFrame *frame);
+
+        /**
+         * @brief Resamples the part of src that lies inside the print frame.
+         *
+         * Applies zoom, position, rotation and mirroring of framing like the
+         * preview does, but relative to src instead of the window: the frame
+         * of aspect_x:aspect_y is fitted into src and the result keeps about
+         * one output pixel per source pixel. Areas outside src are black.
+         *
+         * @return RGBA32 surface, nullptr on failure
+         */
+        static SDL_Surface *resampleFramed(SDL_Surface *src, const Framing *framing);
+
+        /**
+         * @brief Like resampleFramed, but reads the luma plane of a planar YUV
+         * frame directly, without any colour conversion.
+         *
+         * @return gray RGBA32 surface, nullptr if frame has no luma plane
+         */
+        static SDL_Surface *resampleLumaFramed(const CameraFrame *frame, const Framing *framing);
+
+        // convertFrame followed by resampleFramed, or resampleLumaFramed if gray is enough
+        static SDL_Surface *captureFramed(const CameraFrame *frame, const Framing *framing, bool gray);
+
+        /**
+         * @brief Stacks the framed captures of count frames into one strip.
+         *
+         * The strip is width pixels wide, the shots are scaled to fit inside
+         * a white border of gap pixels. tiles receives one PrintTile per
+         * shot, so the tiles can be processed independently and only the
+         * shots, not the white border, are looked at when toning them.
+         *
+         * @return RGBA32 surface, nullptr on failure
+         */
+        static SDL_Surface *composeStrip(const CameraFrame *frames, int count, const Framing *framing, bool gray,
+                                         int width, int gap, std::vector<PrintTile> *tiles);
+    };
+}
+
+#endif // KB_IMAGE_OPS_H
@@ -22,8 +22,17 @@ namespace Kbooth
 	struct CountdownSettings {
 		int len;
 		int pace;	
+		int burst_shots; // pictures taken at 0 and composed into a strip, 1 takes a single picture
+		int burst_interval; // ms between the pictures of a burst
 	};
 
+    // automatic tone mapping of the print before dithering, see AutoTone
+    enum class AutoToneMode {
+        Off,
+        Stretch, // global levels from the histogram
+        Clahe // contrast limited adaptive histogram equalization on tiles
+    };
+
     struct PrintSettings {
 		std::string save_folder;
 		bool save_images;
@@ -31,7 +40,30 @@ namespace Kbooth
 		int usb_port;
 		float brightness;
 		float contrast;
+		float gamma; // > 1 lightens the mid tones
+		int black_level; // input levels, mapped to black and white before gamma and contrast
+		int white_level;
+		AutoToneMode auto_tone;
+		int sharpen_amount; // unsharp mask in percent, 0 is off
+		int sharpen_radius; // in printer dots
+		int sharpen_threshold; // smaller differences to the blur are left alone
+		std::string layout; // print template in ../assets/layouts/, without .ini
         bool landscape;
+        bool banded; // send the raster in bands while the rest is still dithering
+        int band_height; // rows per band
+    };
+
+    // one shot of a burst strip, in strip pixels
+    struct PrintTile {
+        int rows; // the shot and the white gap above it, the last tile also gets the gap below
+        int shot_x, shot_y, shot_w, shot_h; // where the shot is inside the tile, the rest is white
+    };
+
+    // what automatic camera format selection aims for
+    struct FormatTarget {
+        int fps;
+        int width;
+        int height;
     };
 
     struct Settings
@@ -41,7 +73,8 @@ namespace Kbooth
         PrintSettings print_settings;
 		Uint32 capture_button; // Button that triggers image Capture
         bool optimize_rasp_pi;
-        int camera_format_index;
+        int camera_format_index; // < 0 selects automatically, see FormatTarget
+        FormatTarget format_target;
     };
 
     struct UsbDevice {
@@ -0,0 +1,109 @@
+#include "MjpegDecoder.h"
+
+#include "stb_image.h"
+#include <iostream>
+#include <string.h>
+#ifdef KBOOTH_HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
+using namespace Kbooth;
+
+MjpegDecoder::MjpegDecoder() : handle(nullptr) {
+#ifdef KBOOTH_HAVE_TURBOJPEG
+    handle = tjInitDecompress();
+    if (handle == nullptr) {
+        std::cerr << "ERROR: could not initialize libjpeg-turbo: " << tjGetErrorStr2(nullptr) << std::endl;
+    }
+#endif
+}
+
+MjpegDecoder::~MjpegDecoder() {
+#ifdef KBOOTH_HAVE_TURBOJPEG
+    if (handle != nullptr) tjDestroy(handle);
+#endif
+}
+
+bool MjpegDecoder::decodeScaled(const unsigned char *data, size_t size, int min_w, int min_h,
+                                std::vector<unsigned char> *out, int *w, int *h, int *pitch) {
+#ifdef KBOOTH_HAVE_TURBOJPEG
+    if (handle != nullptr) {
+        int width, height, subsampling, colorspace;
+        if (tjDecompressHeader3(handle, data, (unsigned long) size, &width, &height, &subsampling, &colorspace) != 0) {
+            return false;
+        }
+        int scaled_w = width, scaled_h = height;
+        int factors_count;
+        tjscalingfactor *factors = tjGetScalingFactors(&factors_count);
+        for (int i = 0; factors != nullptr && i < factors_count; i++) {
+            if (factors[i].num >= factors[i].denom) continue; // only shrink
+            int factor_w = TJSCALED(width, factors[i]), factor_h = TJSCALED(height, factors[i]);
+            if (factor_w < min_w || factor_h < min_h) continue;
+            if ((long) factor_w * factor_h < (long) scaled_w * scaled_h) {
+                scaled_w = factor_w;
+                scaled_h = factor_h;
+            }
+        }
+        size_t needed = (size_t) scaled_w * 4 * scaled_h;
+        if (out->size() < needed) out->resize(needed);
+        // webcams often send slightly truncated frames, only fatal errors drop the frame
+        if (tjDecompress2(handle, data, (unsigned long) size, out->data(), scaled_w, scaled_w * 4, scaled_h,
+                          TJPF_RGBX, TJFLAG_FASTDCT | TJFLAG_FASTUPSAMPLE) != 0 &&
+            tjGetErrorCode(handle) == TJERR_FATAL) {
+            return false;
+        }
+        *w = scaled_w;
+        *h = scaled_h;
+        *pitch = scaled_w * 4;
+        return true;
+    }
+#endif
+    int width, height, channels;
+    stbi_uc *pixels = stbi_load_from_memory(data, (int) size, &width, &height, &channels, 4);
+    if (pixels == nullptr) return false;
+    size_t needed = (size_t) width * 4 * height;
+    if (out->size() < needed) out->resize(needed);
+    memcpy(out->data(), pixels, needed);
+    stbi_image_free(pixels);
+    *w = width;
+    *h = height;
+    *pitch = width * 4;
+    return true;
+}
+
+SDL_Surface *MjpegDecoder::decode(const unsigned char *data, size_t size) {
+#ifdef KBOOTH_HAVE_TURBOJPEG
+    if (handle != nullptr) {
+        int width, height, subsampling, colorspace;
+        if (tjDecompressHeader3(handle, data, (unsigned long) size, &width, &height, &subsampling, &colorspace) != 0) {
+            std::cerr << "ERROR: could not read jpeg header: " << tjGetErrorStr2(handle) << std::endl;
+            return nullptr;
+        }
+        SDL_Surface *surface = SDL_CreateSurface(width, height, SDL_PIXELFORMAT_RGBA32);
+        if (surface == nullptr) return nullptr;
+        if (tjDecompress2(handle, data, (unsigned long) size, (unsigned char*) surface->pixels,
+                          width, surface->pitch, height, TJPF_RGBA, 0) != 0 &&
+            tjGetErrorCode(handle) == TJERR_FATAL) {
+            std::cerr << "ERROR: could not decode jpeg: " << tjGetErrorStr2(handle) << std::endl;
+            SDL_DestroySurface(surface);
+            return nullptr;
+        }
+        return surface;
+    }
+#endif
+    int width, height, channels;
+    stbi_uc *pixels = stbi_load_from_memory(data, (int) size, &width, &height, &channels, 4);
+    if (pixels == nullptr) {
+        std::cerr << "ERROR: could not decode jpeg: " << stbi_failure_reason() << std::endl;
+        return nullptr;
+    }
+    SDL_Surface *surface = SDL_CreateSurface(width, height, SDL_PIXELFORMAT_RGBA32);
+    if (surface != nullptr) {
+        for (int y = 0; y < height; y++) {
+            memcpy((unsigned char*) surface->pixels + (size_t) y * surface->pitch,
+                   pixels + (size_t) y * width * 4, (size_t) width * 4);
+        }
+    }
+    stbi_image_free(pixels);
+    return surface;
+}
@@ -0,0 +1,39 @@
+#ifndef KB_MJPEG_DECODER_H
+#define KB_MJPEG_DECODER_H
+
+#include <SDL3/SDL.h>
+#include <stddef.h>
+#include <vector>
+
+namespace Kbooth {
+
+    /**
+     * Decodes MJPG camera frames. With libjpeg-turbo (KBOOTH_HAVE_TURBOJPEG)
+     * previews are decoded at a reduced DCT scale, otherwise stb_image
+     * always decodes the full frame.
+     *
+     * Keeps decoder state, use one instance per thread.
+     */
+    class MjpegDecoder {
+    private:
+        void *handle; // tjhandle, nullptr without libjpeg-turbo
+    public:
+        MjpegDecoder();
+        ~MjpegDecoder();
+        MjpegDecoder(const MjpegDecoder&) = delete;
+        MjpegDecoder& operator=(const MjpegDecoder&) = delete;
+
+        /**
+         * @brief Decodes to RGBX32 at the smallest scale that still covers min_w x min_h.
+         *
+         * out only grows, so the buffer is reused between frames.
+         */
+        bool decodeScaled(const unsigned char *data, size_t size, int min_w, int min_h,
+                          std::vector<unsigned char> *out, int *w, int *h, int *pitch);
+
+        // full resolution RGBA32 surface, nullptr on failure
+        SDL_Surface *decode(const unsigned char *data, size_t size);
+    };
+}
+
+#endif // KB_MJPEG_DECODER_H
@@ -0,0 +1,275 @@
+#include "PrintLayout.h"
+#include "EscPosJob.h"
+#include "Printer.h"
+#include "RasterPacker.h"
+#include "SimpleIni.h"
+
+#include <SDL3/SDL.h>
+#include <SDL3_image/SDL_image.h>
+#include <SDL3_ttf/SDL_ttf.h>
+#include <ctime>
+#include <iostream>
+#include <string.h>
+
+using namespace Kbooth;
+
+static const int WIDTH = Printer::PRINT_WIDTH;
+static const uint8_t WHITE = 0xff;
+static const uint8_t BLACK = 0x00;
+
+size_t LayoutRaster::bytes() const {
+    size_t total = 0;
+    for (const RasterBand &band : above) total += EscPosJob::RASTER_HEADER_SIZE + band.data.size();
+    for (const RasterBand &band : below) total += EscPosJob::RASTER_HEADER_SIZE + band.data.size();
+    return total;
+}
+
+static LayoutRegion region(LayoutRegionType type) {
+    return {
+        .type = type, .height = 0, .margin = 0, .padding = 0, .border = 0,
+        .align = 0, .size = 32, .value = "", .font = "font.ttf"
+    };
+}
+
+PrintLayout::PrintLayout() {
+    // what was printed before there were templates
+    LayoutRegion logo = region(LayoutRegionType::Image);
+    logo.value = "./logo.jpg";
+    reset("", {region(LayoutRegionType::Photo), logo});
+}
+
+void PrintLayout::reset(const std::string &name, std::vector<LayoutRegion> regions) {
+    this->name = name;
+    this->regions = std::move(regions);
+    bands.assign(this->regions.size(), RasterBand{.rows = 0, .data = {}});
+    texts.assign(this->regions.size(), std::string());
+    rendered.assign(this->regions.size(), false);
+    raster = nullptr;
+}
+
+static bool parseType(const std::string &type, LayoutRegionType *out) {
+    if (type == "photo") *out = LayoutRegionType::Photo;
+    else if (type == "image") *out = LayoutRegionType::Image;
+    else if (type == "text") *out = LayoutRegionType::Text;
+    else if (type == "date") *out = LayoutRegionType::Date;
+    else if (type == "space") *out = LayoutRegionType::Space;
+    else if (type == "line") *out = LayoutRegionType::Line;
+    else return false;
+    return true;
+}
+
+static std::string trim(const std::string &s) {
+    size_t first = s.find_first_not_of(" \t");
+    if (first == std::string::npos) return "";
+    return s.substr(first, s.find_last_not_of(" \t") - first + 1);
+}
+
+bool PrintLayout::load(const std::string &name) {
+    std::string path = std::string(DIRECTORY) + name + ".ini";
+    this->name = name;
+    CSimpleIniA ini;
+    ini.SetUnicode();
+    if (ini.LoadFile(path.c_str()) < 0) {
+        std::cerr << "ERROR: could not read print layout " << path << std::endl;
+        return false;
+    }
+    std::vector<LayoutRegion> parsed;
+    int photos = 0;
+    std::string list = ini.GetValue("layout", "regions", "");
+    for (size_t start = 0; start <= list.size();) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) end = list.size();
+        std::string section = trim(list.substr(start, end - start));
+        start = end + 1;
+        if (section.empty()) continue;
+
+        LayoutRegionType type;
+        if (!parseType(ini.GetValue(section.c_str(), "type", ""), &type)) {
+            std::cerr << "ERROR: print layout " << name << ": region " << section << " has no valid type" << std::endl;
+            return false;
+        }
+        LayoutRegion r = region(type);
+        r.height = (int) ini.GetLongValue(section.c_str(), "height", 0);
+        r.margin = (int) ini.GetLongValue(section.c_str(), "margin", 0);
+        r.padding = (int) ini.GetLongValue(section.c_str(), "padding", 0);
+        r.border = (int) ini.GetLongValue(section.c_str(), "border", 0);
+        r.size = (int) ini.GetLongValue(section.c_str(), "size", r.size);
+        r.font = ini.GetValue(section.c_str(), "font", r.font.c_str());
+        std::string align = ini.GetValue(section.c_str(), "align", "center");
+        r.align = align == "left" ? -1 : align == "right" ? 1 : 0;
+        if (type == LayoutRegionType::Image) r.value = ini.GetValue(section.c_str(), "file", "");
+        if (type == LayoutRegionType::Text) r.value = ini.GetValue(section.c_str(), "text", "");
+        if (type == LayoutRegionType::Date) r.value = ini.GetValue(section.c_str(), "format", "%d.%m.%Y %H:%M");
+
+        // whatever is left of the photo has to stay wide enough to be worth printing
+        int frame = r.margin + (type == LayoutRegionType::Photo ? r.border : 0);
+        if (r.height < 0 || r.padding < 0 || r.border < 0 || r.margin < 0 || r.size <= 0 ||
+            WIDTH - 2 * frame < WIDTH / 4) {
+            std::cerr << "ERROR: print layout " << name << ": region " << section << " is out of range" << std::endl;
+            return false;
+        }
+        if (type == LayoutRegionType::Photo) photos++;
+        parsed.push_back(r);
+    }
+    if (photos != 1) {
+        std::cerr << "ERROR: print layout " << name << " needs exactly one photo region" << std::endl;
+        return false;
+    }
+    reset(name, std::move(parsed));
+    return true;
+}
+
+// dither output convention, one byte per dot, packed into a band
+static void packCanvas(const std::vector<uint8_t> &canvas, int rows, RasterBand *band) {
+    band->rows = rows;
+    band->data.assign((size_t) ((WIDTH + 7) / 8) * rows, 0);
+    RasterPacker::packRows(canvas.data(), WIDTH, rows, band->data.data());
+}
+
+// the picture scaled to the width between the margins and dithered like a photo, but without any tone settings
+static bool renderImage(const LayoutRegion &r, std::vector<uint8_t> *canvas, int *rows) {
+    SDL_Surface *image = IMG_Load(r.value.c_str());
+    if (image == nullptr) {
+        std::cerr << "ERROR: could not load layout image " << r.value << ": " << SDL_GetError() << std::endl;
+        return false;
+    }
+    PrintSettings plain = {};
+    int width, height;
+    uint8_t *dithered = Printer::ditherSdlSurface(image, &plain, WIDTH - 2 * r.margin, &width, &height);
+    SDL_DestroySurface(image);
+    if (dithered == nullptr) return false;
+    *rows = height + 2 * r.padding;
+    canvas->assign((size_t) WIDTH * *rows, WHITE);
+    for (int y = 0; y < height; y++) {
+        memcpy(canvas->data() + (size_t) (y + r.padding) * WIDTH + r.margin, dithered + (size_t) y * width, width);
+    }
+    free(dithered);
+    return true;
+}
+
+// text is not dithered but thresholded, so thin strokes stay solid
+static bool renderText(const LayoutRegion &r, const std::string &text, std::vector<uint8_t> *canvas, int *rows) {
+    std::string font_path = "../assets/fonts/" + r.font;
+    TTF_Font *font = TTF_OpenFont(font_path.c_str(), (float) r.size);
+    if (font == nullptr) {
+        std::cerr << "ERROR: could not open layout font " << font_path << ": " << SDL_GetError() << std::endl;
+        return false;
+    }
+    SDL_Surface *rendered = text.empty() ? nullptr : TTF_RenderText_Blended(font, text.c_str(), 0, {0, 0, 0, 255});
+    TTF_CloseFont(font);
+    SDL_Surface *glyphs = rendered != nullptr ? SDL_ConvertSurface(rendered, SDL_PIXELFORMAT_RGBA32) : nullptr;
+    if (rendered != nullptr) SDL_DestroySurface(rendered);
+    if (glyphs == nullptr) {
+        if (!text.empty()) std::cerr << "ERROR: could not render layout text: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    int inner = WIDTH - 2 * r.margin;
+    int w = glyphs->w < inner ? glyphs->w : inner; // cut off on the right
+    int x0 = r.margin + (r.align < 0 ? 0 : r.align > 0 ? inner - w : (inner - w) / 2);
+    *rows = glyphs->h + 2 * r.padding;
+    canvas->assign((size_t) WIDTH * *rows, WHITE);
+    for (int y = 0; y < glyphs->h; y++) {
+        const uint8_t *src = (const uint8_t*) glyphs->pixels + (size_t) y * glyphs->pitch;
+        uint8_t *dst = canvas->data() + (size_t) (y + r.padding) * WIDTH + x0;
+        for (int x = 0; x < w; x++) {
+            if (src[x * 4 + 3] >= 128) dst[x] = BLACK;
+        }
+    }
+    SDL_DestroySurface(glyphs);
+    return true;
+}
+
+// rows of black between the margins
+static void fillRows(std::vector<uint8_t> *canvas, int y, int rows, int margin) {
+    for (int i = 0; i < rows; i++) {
+        memset(canvas->data() + (size_t) (y + i) * WIDTH + margin, BLACK, WIDTH - 2 * margin);
+    }
+}
+
+void PrintLayout::renderRegion(size_t index, const std::string &text) {
+    const LayoutRegion &r = regions[index];
+    std::vector<uint8_t> canvas;
+    int rows = 0;
+    bool ok = true;
+    switch (r.type) {
+        case LayoutRegionType::Image:
+            ok = renderImage(r, &canvas, &rows);
+            break;
+        case LayoutRegionType::Text:
+        case LayoutRegionType::Date:
+            ok = renderText(r, text, &canvas, &rows);
+            break;
+        case LayoutRegionType::Space:
+            rows = r.height + 2 * r.padding;
+            canvas.assign((size_t) WIDTH * rows, WHITE);
+            break;
+        case LayoutRegionType::Line:
+            rows = r.height + 2 * r.padding;
+            canvas.assign((size_t) WIDTH * rows, WHITE);
+            fillRows(&canvas, r.padding, r.height, r.margin);
+            break;
+        default:
+            break;
+    }
+    // a region that could not be rendered keeps its padding, the print still goes out
+    if (!ok) {
+        rows = 2 * r.padding;
+        canvas.assign((size_t) WIDTH * rows, WHITE);
+    }
+    packCanvas(canvas, rows, &bands[index]);
+    texts[index] = text;
+    rendered[index] = true;
+}
+
+// the photo frame: padding, then border rows on the side of the photo
+static void frameBand(const LayoutRegion &r, bool top, RasterBand *band) {
+    int rows = r.padding + r.border;
+    std::vector<uint8_t> canvas((size_t) WIDTH * rows, WHITE);
+    fillRows(&canvas, top ? r.padding : 0, r.border, r.margin);
+    packCanvas(canvas, rows, band);
+}
+
+std::shared_ptr<const LayoutRaster> PrintLayout::prepare() {
+    bool changed = raster == nullptr;
+    std::time_t t = std::time(nullptr);
+    std::tm tm = *std::localtime(&t);
+    for (size_t i = 0; i < regions.size(); i++) {
+        const LayoutRegion &r = regions[i];
+        if (r.type == LayoutRegionType::Photo) continue;
+        std::string text = r.value;
+        if (r.type == LayoutRegionType::Date) {
+            char buffer[128];
+            size_t length = strftime(buffer, sizeof(buffer), r.value.c_str(), &tm);
+            text.assign(buffer, length);
+        }
+        if (rendered[i] && texts[i] == text) continue;
+        renderRegion(i, text);
+        changed = true;
+    }
+    if (!changed) return raster;
+
+    // jobs still in the queue keep the raster they were submitted with
+    std::shared_ptr<LayoutRaster> next = std::make_shared<LayoutRaster>();
+    bool below = false;
+    for (size_t i = 0; i < regions.size(); i++) {
+        const LayoutRegion &r = regions[i];
+        std::vector<RasterBand> &side = below ? next->below : next->above;
+        if (r.type != LayoutRegionType::Photo) {
+            if (bands[i].rows > 0) side.push_back(bands[i]);
+            continue;
+        }
+        RasterBand frame;
+        frameBand(r, true, &frame);
+        if (frame.rows > 0) next->above.push_back(frame);
+        frameBand(r, false, &frame);
+        if (frame.rows > 0) next->below.push_back(frame);
+        next->photo_x = r.margin + r.border;
+        next->photo_width = WIDTH - 2 * next->photo_x;
+        next->photo_row.assign(WIDTH, WHITE);
+        memset(next->photo_row.data() + r.margin, BLACK, r.border);
+        memset(next->photo_row.data() + WIDTH - r.margin - r.border, BLACK, r.border);
+        below = true;
+    }
+    raster = next;
+    return raster;
+}
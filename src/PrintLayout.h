@@ -0,0 +1,86 @@
+#ifndef KB_PRINT_LAYOUT_H
+#define KB_PRINT_LAYOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Kbooth {
+
+    enum class LayoutRegionType {
+        Photo, // the capture, dithered for every print
+        Image, // a picture file, e.g. the logo
+        Text, // a caption
+        Date, // the time of the print
+        Space, // white rows
+        Line // a black rule
+    };
+
+    // one horizontal band of a print layout, sizes in printer dots
+    struct LayoutRegion {
+        LayoutRegionType type;
+        int height; // Space and Line: rows
+        int margin; // white dots left and right
+        int padding; // white rows above and below
+        int border; // Photo: width of the black frame around it
+        int align; // Text and Date: -1 left, 0 centered, 1 right
+        int size; // Text and Date: font size in dots
+        std::string value; // Image: file, Text: the caption, Date: strftime format
+        std::string font; // Text and Date: file in ../assets/fonts/
+    };
+
+    // packed GS v 0 rows over the whole printer width
+    struct RasterBand {
+        int rows;
+        std::vector<unsigned char> data;
+    };
+
+    /**
+     * A layout rendered at printer resolution. Everything around the photo
+     * is packed rows that are copied into every print job as they are, only
+     * the photo is dithered per job and packed into photo_row.
+     */
+    struct LayoutRaster {
+        std::vector<RasterBand> above; // up to and including the top of the photo frame
+        std::vector<RasterBand> below;
+        int photo_x; // first dot of the photo
+        int photo_width; // dots the photo is scaled to
+        std::vector<uint8_t> photo_row; // one byte per dot (0xff = white) with the frame, the photo goes over it
+
+        size_t bytes() const; // of all bands, raster headers included
+    };
+
+    /**
+     * Print template from DIRECTORY/<name>.ini: a [layout] section lists
+     * the regions from the top of the print, each region is a section of
+     * its own. The static regions are rendered once and only a date is
+     * rendered again when its text changes.
+     */
+    class PrintLayout {
+    private:
+        std::string name;
+        std::vector<LayoutRegion> regions;
+        std::vector<RasterBand> bands; // by region, empty for the photo
+        std::vector<std::string> texts; // what each band was rendered from
+        std::vector<bool> rendered;
+        std::shared_ptr<const LayoutRaster> raster;
+
+        void reset(const std::string &name, std::vector<LayoutRegion> regions);
+        void renderRegion(size_t index, const std::string &text);
+    public:
+        static constexpr const char *DIRECTORY = "../assets/layouts/";
+
+        PrintLayout(); // built in, without a name: the photo above ./logo.jpg
+
+        const std::string &getName() const { return name; }
+        // reads and checks the template; when that fails the current layout is kept under the new name,
+        // so a broken template is reported once and not for every print
+        bool load(const std::string &name);
+        // the rendered layout, shared with the print jobs that still use it
+        std::shared_ptr<const LayoutRaster> prepare();
+    };
+}
+
+#endif // KB_PRINT_LAYOUT_H
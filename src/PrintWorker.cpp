@@ -0,0 +1,161 @@
+#include "PrintWorker.h"
+#include "Kbooth.h"
+#include "Printer.h"
+#include "ToneCurve.h"
+
+#include "SDL3_image/SDL_image.h"
+#include <algorithm>
+#include <iostream>
+
+using namespace Kbooth;
+
+PrintWorker::PrintWorker(Printer *printer) :
+    printer(printer),
+    stopping(false),
+    next_job_id(0),
+    status({.job_id = 0, .state = PrintJobState::Idle, .queued = 0, .updated_at = 0}) {
+    thread = std::thread(&PrintWorker::run, this);
+}
+
+PrintWorker::~PrintWorker() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (thread.joinable()) thread.join();
+    // jobs that never started are still saved, only their prints are dropped
+    for (PrintJob &job : jobs) {
+        save(job);
+        SDL_DestroySurface(job.surface);
+    }
+    std::cout << "Closing Print Worker" << std::endl;
+}
+
+bool PrintWorker::submit(SDL_Surface *surface, std::shared_ptr<const LayoutRaster> layout, PrintSettings *print_set,
+                         std::string filename, const std::vector<PrintTile> &tiles) {
+    if (surface == nullptr) return false;
+    int job_id;
+    bool accepted = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        PrintSettings job_settings = *print_set;
+        int prints = (int) std::count_if(jobs.begin(), jobs.end(),
+                                         [](const PrintJob &job) { return job.print_settings.print_images; });
+        if (job_settings.print_images && prints >= QUEUE_CAPACITY) {
+            std::cerr << "Print queue full, dropping print." << std::endl;
+            job_settings.print_images = false;
+            accepted = false;
+        }
+        if (!job_settings.print_images && filename.empty()) {
+            SDL_DestroySurface(surface);
+            return false;
+        }
+        job_id = ++next_job_id;
+        jobs.push_back({
+            .id = job_id,
+            .surface = surface,
+            .layout = layout,
+            .print_settings = job_settings,
+            .filename = filename,
+            .tiles = tiles
+        });
+    }
+    setState(job_id, PrintJobState::Queued);
+    cv.notify_one();
+    return accepted;
+}
+
+PrintJobStatus PrintWorker::getStatus() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return status;
+}
+
+void PrintWorker::setState(int job_id, PrintJobState state) {
+    std::lock_guard<std::mutex> lock(mutex);
+    status.job_id = job_id;
+    status.state = state;
+    status.queued = (int) jobs.size();
+    status.updated_at = SDL_GetTicks();
+}
+
+void PrintWorker::run() {
+    while (true) {
+        PrintJob job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping) return;
+            job = jobs.front();
+            jobs.pop_front();
+        }
+        bool success = process(job);
+        SDL_DestroySurface(job.surface);
+        setState(job.id, success ? PrintJobState::Done : PrintJobState::Failed);
+    }
+}
+
+// ToneCurve::applyRGBA works on any of these, the color channels all get the same curve
+static bool alphaLast(SDL_PixelFormat format) {
+    return format == SDL_PIXELFORMAT_RGBA32 || format == SDL_PIXELFORMAT_BGRA32 ||
+           format == SDL_PIXELFORMAT_RGBX32 || format == SDL_PIXELFORMAT_BGRX32;
+}
+
+bool PrintWorker::save(PrintJob &job) {
+    if (job.filename.empty()) return true;
+    setState(job.id, PrintJobState::Saving);
+    if (!IMG_SaveJPG(job.surface, job.filename.c_str(), 100)) {
+        std::cerr << "Could not save image: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool PrintWorker::process(PrintJob &job) {
+    PrintSettings *print_set = &job.print_settings;
+    SDL_Surface *capture_surface = job.surface;
+    bool success = save(job);
+    if (!print_set->print_images) return success;
+    setState(job.id, PrintJobState::Dithering);
+
+    // the job owns the capture and it is saved already, so the tone curve is applied in place;
+    // only captures read back from the renderer in another format need a copy
+    SDL_Surface *photo = alphaLast(capture_surface->format) ?
+        capture_surface : SDL_ConvertSurface(capture_surface, SDL_PIXELFORMAT_RGBA32);
+    if (photo == nullptr) {
+        std::cerr << "Could not convert print surface: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    ToneCurve tone(print_set);
+    if (!tone.isIdentity()) {
+        tone.applyRGBA((const uint8_t*) photo->pixels, photo->pitch,
+                       (uint8_t*) photo->pixels, photo->pitch, photo->w, photo->h);
+    }
+    // everything around the photo is already rendered, only the photo is dithered here
+    const LayoutRaster *layout = job.layout.get();
+    int dots = layout != nullptr ? layout->photo_width : Printer::PRINT_WIDTH;
+
+    // a strip is dithered shot by shot in parallel instead, see Printer::ditherSdlSurfaceTiled
+    if (print_set->banded && job.tiles.empty()) {
+        success = printer->printSdlSurfaceBanded(photo, print_set, layout, [this, &job] {
+            setState(job.id, PrintJobState::Sending);
+        }) && success;
+        if (photo != capture_surface) SDL_DestroySurface(photo);
+        return success;
+    }
+
+    int width, height;
+    uint8_t *out_image;
+    if (job.tiles.empty()) {
+        out_image = Printer::ditherSdlSurface(photo, print_set, dots, &width, &height);
+    } else {
+        out_image = printer->ditherSdlSurfaceTiled(photo, print_set, job.tiles, dots, &width, &height);
+    }
+    if (photo != capture_surface) SDL_DestroySurface(photo);
+    if (out_image == nullptr) return false;
+
+    setState(job.id, PrintJobState::Sending);
+    success = printer->printDitheredImage(out_image, width, height, layout) && success;
+    free(out_image);
+    return success;
+}
@@ -0,0 +1,84 @@
+#ifndef KB_PRINT_WORKER_H
+#define KB_PRINT_WORKER_H
+
+#include <SDL3/SDL.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Kbooth.h"
+#include "Printer.h"
+#include "PrintLayout.h"
+
+namespace Kbooth {
+
+    enum class PrintJobState {
+        Idle, // no job has been submitted yet
+        Queued,
+        Saving, // writing the jpg, jobs that are not printed end after this
+        Dithering,
+        Sending,
+        Done,
+        Failed
+    };
+
+    struct PrintJobStatus {
+        int job_id; // id of the most recently updated job
+        PrintJobState state;
+        int queued; // jobs waiting behind the current one
+        Uint64 updated_at; // SDL_GetTicks() of the last state change
+    };
+
+    struct PrintJob {
+        int id;
+        SDL_Surface *surface; // owned by the job, destroyed by the worker
+        std::shared_ptr<const LayoutRaster> layout; // around the photo, nullptr prints the photo alone
+        PrintSettings print_settings;
+        std::string filename; // empty if the image should not be saved
+        std::vector<PrintTile> tiles; // the shots of a strip, dithered in parallel; empty for one picture
+    };
+
+    /**
+     * Runs saving, image preparation, dithering and the USB transfer of
+     * captured images on its own thread, so the render loop never waits
+     * for the printer.
+     */
+    class PrintWorker {
+    private:
+        static const int QUEUE_CAPACITY = 4; // of jobs that print, saving never waits for the printer
+
+        Printer *printer;
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<PrintJob> jobs;
+        bool stopping;
+        int next_job_id;
+        PrintJobStatus status;
+
+        void run();
+        bool process(PrintJob &job);
+        bool save(PrintJob &job); // true if there is nothing to save
+        void setState(int job_id, PrintJobState state);
+    public:
+        PrintWorker(Printer *printer);
+        ~PrintWorker();
+
+        /**
+         * @brief Queues a capture for saving and printing.
+         *
+         * Takes ownership of surface, also when the job gets rejected. When
+         * the print queue is full the capture is still saved, only the
+         * print is dropped and false is returned. tiles splits a photo
+         * strip into its shots, see Printer::ditherSdlSurfaceTiled.
+         */
+        bool submit(SDL_Surface *surface, std::shared_ptr<const LayoutRaster> layout, PrintSettings *print_set,
+                    std::string filename, const std::vector<PrintTile> &tiles);
+        PrintJobStatus getStatus();
+    };
+}
+
+#endif // KB_PRINT_WORKER_H
@@ -1,25 +1,22 @@
 #include "Printer.h"
+#include "AutoTone.h"
+#include "UnsharpMask.h"
 #include <libusb.h>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include <iostream>
-#include "EscPosCommands.h"
 #include "SDL3/SDL.h"
 #include "libdither.h"
 #include <chrono>
 #include <string>
+#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+#include <string.h>
 
 using namespace Kbooth;
 
-int brightnessContrast(float b, float c, float x) {
-    float factor = (259.0f * (c + 255.0f)) / (255.0f * (259.0f - c));
-    float y = factor * (x - 128.0f) + 128.0f + b;
-    if (y < 0.0f) return 0;
-    if (y > 255.0f) return 255;
-    
-    return (int)y;
-}
- 
 bool Printer::initAndOpen(UsbDevice *default_dev) {
     std::cout << "HERE I AM" << std::endl;
     ctx = nullptr;
@@ -45,7 +42,7 @@ bool Printer::initAndOpen(UsbDevice *default_dev) {
 		return false;
 	}
 
-	return true;
+	return transport.start(ctx, handle, ENDPOINT);
 }
 
 bool Printer::init() {
@@ -132,122 +129,311 @@ bool Printer::open(UsbDevice& dev) {
 		libusb_close(handle);
 		return false;
 	}
-	return true;
+	return transport.start(ctx, handle, ENDPOINT);
 }
 
 void Printer::cleanup() {
+    transport.stop();
 	if (handle != nullptr && handle != NULL) libusb_close(handle);
+    handle = nullptr;
     libusb_exit(ctx);
 }
 
 Printer::~Printer() {
+    transport.stop();
 	if (handle != nullptr && handle != NULL) libusb_close(handle);
     libusb_exit(ctx);
 	std::cout << "Closing Printer resources" << std::endl;
 }
 
-int Printer::send_command(std::vector<unsigned char> command) {
-	int actual_len;
-	unsigned char ENDPOINT = 0x01;
-	int err = libusb_bulk_transfer(handle, 
-								ENDPOINT, 
-								const_cast<unsigned char*>(command.data()), 
-								command.size(),
-								&actual_len, 
-								50000);
-	if (err) {
-		std::cerr << "ERROR: could not write to open usb device: " << (int) err << std::endl;
+int Printer::send_command(const unsigned char *data, int length) {
+	uint64_t ticket = transport.write(data, length);
+	if (!transport.wait(ticket, SEND_TIMEOUT_MS)) {
+		std::cerr << "ERROR: could not write to open usb device." << std::endl;
 		return 1;
 	}
-	return err;
+	return 0;
 }
 
-int Printer::cut() {
-    unsigned char n = 25;  // Set 'n' to the desired feed length (e.g., 5 vertical motion units)
-    std::vector<unsigned char> cutCommand2 = {0x1D, 0x56, 0x42, n};
+uint64_t Printer::flush() {
+    uint64_t ticket = transport.write(job.unflushed(), job.unflushedSize());
+    job.markFlushed();
+    return ticket;
+}
 
-	int err = send_command(cutCommand2);
-	if (err) {
-		std::cerr << "Error while sending data: " << err << std::endl; 
-	}
-	return err;
+void Printer::beginJob(size_t raster_bytes, const LayoutRaster *layout) {
+	transport.reset();
+    job.clear();
+    // everything is reserved up front, flushed bytes must not move while in flight
+    job.reserve(raster_bytes + (layout != nullptr ? layout->bytes() : 0) + JOB_COMMAND_BYTES);
+    job.init().lineSpacing(0);
+    if (layout != nullptr) appendBands(layout->above);
+}
+
+void Printer::endJob(const LayoutRaster *layout) {
+    if (layout != nullptr) appendBands(layout->below);
+    job.defaultLineSpacing().lineFeed().feed(0).cut(25);
+}
+
+void Printer::appendBands(const std::vector<RasterBand> &bands) {
+    for (const RasterBand &band : bands) {
+        unsigned char *dst = job.raster(PRINT_WIDTH, band.rows);
+        if (dst == nullptr) return;
+        memcpy(dst, band.data.data(), band.data.size());
+    }
 }
 
-void Printer::printDitheredImage(uint8_t *image, int width, int height) {
+void Printer::appendPhoto(const uint8_t *image, int width, int rows, const LayoutRaster *layout) {
+    if (layout == nullptr || (layout->photo_x == 0 && width == PRINT_WIDTH)) {
+        unsigned char *dst = job.raster(width, rows);
+        if (dst != nullptr) RasterPacker::packRows(image, width, rows, dst);
+        return;
+    }
+    // the frame row is copied in once, then every row only overwrites the photo dots
+    unsigned char *dst = job.raster(PRINT_WIDTH, rows);
+    if (dst == nullptr) return;
+    std::vector<uint8_t> row = layout->photo_row;
+    int copy = std::min(width, layout->photo_width);
+    for (int y = 0; y < rows; y++) {
+        memcpy(row.data() + layout->photo_x, image + (size_t) y * width, copy);
+        RasterPacker::packRow(row.data(), PRINT_WIDTH, dst + (size_t) y * ((PRINT_WIDTH + 7) / 8));
+    }
+}
+
+bool Printer::printDitheredImage(uint8_t *image, int width, int height, const LayoutRaster *layout) {
 	std::cout << "WidthxHeight apparently " << width << "x" << height << std::endl;
-	send_command(ESC_Init);
-	send_command(ESC_Three);
-	int width_char = (int) std::ceil((float) width / 8.0f);
-	unsigned char yL = (unsigned char) (height % 256);
-	unsigned char yH = (unsigned char) (height / 256);
-    unsigned char xL = (unsigned char) (width_char % 256);
-    unsigned char xH = (unsigned char) (width_char / 256);
-	int x_num = 0;
-	int y_num = 0;
-    std::vector<unsigned char> total = {
-        '\x1d', '\x76', '\x30', '\x00',
-        xL, xH, yL, yH
-    };
-	for (int y = 0; y < height; y++) {
-		for (int x = 0; x < width;) {
-			char d_k = 0;
-			for (int c = 0; c < 8 && x < width; c++, x++) {
-				if (image[y * width + x] != 0xff) {
-					d_k |= (1 << (7 - c));
-				}
-			}
-			total.push_back(d_k);
-			if (y == 0) x_num++;
-		}
-		y_num++;
-	}
-    send_command(total);
-    send_command(ESC_Two);
-	send_command(ESC_LF);
-	send_command(ESC_J);
-	cut();
-	std::cout << "AFTER DATA TRANS: " << total.size() << "WxH: " << x_num << "x"  << y_num << std::endl; 
-	std::cout << "xL "<< (int) xL << ", xH "<< (int) xH << ", yL "<< (int) yL << ", yH "<< (int) yH << std::endl; 
+	beginJob(EscPosJob::rasterSize(layout != nullptr ? PRINT_WIDTH : width, height), layout);
+	appendPhoto(image, width, height, layout);
+	endJob(layout);
+	int err = send_command(job.data(), (int) job.size());
+	std::cout << "AFTER DATA TRANS: " << job.size() << " WxH: " << (width + 7) / 8 << "x"  << height << std::endl; 
+	return !err;
 }
 
-void Printer::printSdlSurface(SDL_Surface *capture_surface, PrintSettings *print_set) {
-    int w, h;
-    SDL_Surface *scaled_surface;
-    DitherImage* dither_image;
+bool Printer::printSdlSurface(SDL_Surface *capture_surface, PrintSettings *print_set) {
+    int width, height;
+    uint8_t *out_image = ditherSdlSurface(capture_surface, print_set, PRINT_WIDTH, &width, &height);
+    if (out_image == nullptr) return false;
+    bool success = printDitheredImage(out_image, width, height, nullptr);
+    free(out_image);
+    return success;
+}
+
+// byte order of an SDL surface for DitherImage_from_pixels; false if it has to be converted first
+static bool ditherPixelFormat(SDL_PixelFormat format, DitherPixelFormat *dither_format) {
+    switch (format) {
+        case SDL_PIXELFORMAT_RGBA32:
+        case SDL_PIXELFORMAT_RGBX32: *dither_format = DITHER_PIXEL_RGBA32; return true;
+        case SDL_PIXELFORMAT_BGRA32:
+        case SDL_PIXELFORMAT_BGRX32: *dither_format = DITHER_PIXEL_BGRA32; return true;
+        case SDL_PIXELFORMAT_ARGB32:
+        case SDL_PIXELFORMAT_XRGB32: *dither_format = DITHER_PIXEL_ARGB32; return true;
+        case SDL_PIXELFORMAT_ABGR32:
+        case SDL_PIXELFORMAT_XBGR32: *dither_format = DITHER_PIXEL_ABGR32; return true;
+        case SDL_PIXELFORMAT_RGB24: *dither_format = DITHER_PIXEL_RGB24; return true;
+        case SDL_PIXELFORMAT_BGR24: *dither_format = DITHER_PIXEL_BGR24; return true;
+        default: return false;
+    }
+}
+
+// runs the 8 bit stages on region of the print-bound image, the rest is left as it is
+static void enhancePhoto(DitherImage *dither_image, PrintSettings *print_set, const SDL_Rect &region) {
+    bool sharpen = print_set->sharpen_amount > 0 && print_set->sharpen_radius > 0;
+    if (print_set->auto_tone == AutoToneMode::Off && !sharpen) return;
+    int width = dither_image->width, height = dither_image->height;
+    std::vector<uint8_t> gray((size_t) width * height);
+    DitherImage_to_gray8(dither_image, true, gray.data());
+    uint8_t *pixels = gray.data() + (size_t) region.y * width + region.x;
+    AutoTone::apply(print_set->auto_tone, pixels, region.w, region.h, width);
+    // after the tone mapping, which would otherwise stretch the halos too
+    if (sharpen) {
+        UnsharpMask::apply(pixels, region.w, region.h, width, print_set->sharpen_radius,
+                           print_set->sharpen_amount, print_set->sharpen_threshold);
+    }
+    DitherImage_set_gray8(dither_image, gray.data(), true);
+}
+
+DitherImage *Printer::createDitherImage(SDL_Surface *capture_surface, PrintSettings *print_set, int dots,
+                                        const SDL_Rect *tone_region) {
+    int scaled_width, scaled_height;
     if (print_set->landscape) {
-        int max_height = 576;
-        float scaled_width = (float) capture_surface->w * max_height / (float) capture_surface->h;
-        scaled_surface = SDL_ScaleSurface(capture_surface, (int) scaled_width, max_height, SDL_SCALEMODE_LINEAR);
-        dither_image = DitherImage_new(scaled_surface->h, scaled_surface->w);
+        int max_height = dots;
+        scaled_width = (int) ((float) capture_surface->w * max_height / (float) capture_surface->h);
+        scaled_height = max_height;
     } else {
-        int max_width = 576;
-        float scaled_height = (float) capture_surface->h * max_width / (float) capture_surface->w;
-        scaled_surface = SDL_ScaleSurface(capture_surface, max_width, (int) scaled_height, SDL_SCALEMODE_LINEAR);
-        dither_image = DitherImage_new(scaled_surface->w, scaled_surface->h);
+        int max_width = dots;
+        scaled_width = max_width;
+        scaled_height = (int) ((float) capture_surface->h * max_width / (float) capture_surface->w);
+    }
+    SDL_Surface *source = capture_surface;
+    DitherPixelFormat format;
+    if (!ditherPixelFormat(source->format, &format)) {
+        source = SDL_ConvertSurface(capture_surface, SDL_PIXELFORMAT_RGBA32);
+        if (source == nullptr) {
+            std::cerr << "ERROR: could not convert print surface: " << SDL_GetError() << std::endl;
+            return nullptr;
+        }
+        format = DITHER_PIXEL_RGBA32;
+    }
+    // scaling, gray conversion and rotation happen in one pass straight from the captured pixels;
+    // landscape prints are turned clockwise so the long side runs along the paper
+    SDL_LockSurface(source);
+    DitherImage *dither_image = DitherImage_from_pixels_scaled(
+        (const uint8_t*) source->pixels, source->w, source->h, source->pitch,
+        format, print_set->landscape ? DITHER_ROTATE_90 : DITHER_ROTATE_NONE, true,
+        scaled_width, scaled_height);
+    SDL_UnlockSurface(source);
+    if (source != capture_surface) SDL_DestroySurface(source);
+    if (dither_image == nullptr) return nullptr;
+
+    SDL_Rect region = {.x = 0, .y = 0, .w = dither_image->width, .h = dither_image->height};
+    if (tone_region != nullptr && !print_set->landscape) {
+        // rounded inwards, so the scaled pixels blended with what is around the region are left out
+        float scale_x = (float) scaled_width / capture_surface->w, scale_y = (float) scaled_height / capture_surface->h;
+        int x0 = std::max(0, (int) ceilf(tone_region->x * scale_x));
+        int y0 = std::max(0, (int) ceilf(tone_region->y * scale_y));
+        int x1 = std::min(dither_image->width, (int) floorf((tone_region->x + tone_region->w) * scale_x));
+        int y1 = std::min(dither_image->height, (int) floorf((tone_region->y + tone_region->h) * scale_y));
+        if (x1 > x0 && y1 > y0) region = {.x = x0, .y = y0, .w = x1 - x0, .h = y1 - y0};
+    }
+    enhancePhoto(dither_image, print_set, region);
+    return dither_image;
+}
+
+// rows dithered in parallel; the Pi has four cores, more threads only add synchronization
+static int ditherThreads() {
+    unsigned int cores = std::thread::hardware_concurrency();
+    if (cores == 0) return 1;
+    return (int) std::min(cores, 4u);
+}
+
+uint8_t *Printer::ditherSdlSurface(SDL_Surface *capture_surface, PrintSettings *print_set, int dots,
+                                   int *width, int *height) {
+    DitherImage* dither_image = createDitherImage(capture_surface, print_set, dots);
+    if (dither_image == nullptr) return nullptr;
+    uint8_t *out_image = (uint8_t*)calloc(dither_image->width * dither_image->height, sizeof(uint8_t));
+    ErrorDiffusionMatrix *em = get_robert_kist_matrix();
+    FastErrorDiffusionState *state = FastErrorDiffusionState_new(dither_image, em, false);
+    FastErrorDiffusionState_set_threads(state, ditherThreads());
+    fast_error_diffusion_dither_rows(state, dither_image->height, out_image);
+    FastErrorDiffusionState_free(state);
+    // dbs_dither(dither_image, 3, out_image);
+    *width = dither_image->width;
+    *height = dither_image->height;
+
+    ErrorDiffusionMatrix_free(em);
+    DitherImage_free(dither_image);
+    return out_image;
+}
+
+uint8_t *Printer::ditherSdlSurfaceTiled(SDL_Surface *capture_surface, PrintSettings *print_set,
+                                        const std::vector<PrintTile> &tiles, int dots, int *width, int *height) {
+    // strips are always printed in portrait, also when they are dithered as a whole
+    PrintSettings portrait = *print_set;
+    portrait.landscape = false;
+    int total = 0;
+    for (const PrintTile &tile : tiles) total += tile.rows;
+    if (tiles.empty() || total != capture_surface->h) {
+        return ditherSdlSurface(capture_surface, &portrait, dots, width, height);
+    }
+    // each tile is scaled to dots on its own, its rows the same way createDitherImage scales them
+    std::vector<int> scaled_rows(tiles.size()), scaled_y(tiles.size());
+    int scaled_total = 0;
+    for (size_t i = 0; i < tiles.size(); i++) {
+        scaled_y[i] = scaled_total;
+        scaled_rows[i] = (int) ((float) tiles[i].rows * dots / (float) capture_surface->w);
+        scaled_total += scaled_rows[i];
     }
-    w = scaled_surface->w;
-    h = scaled_surface->h;
-    Uint8 r, g, b;
-    for (int x = 0; x < w; x++) {
-        for (int y = 0; y < h; y++) {
-            SDL_ReadSurfacePixel(scaled_surface, x, y, &r, &g, &b, NULL);
-            if (print_set->landscape) {
-                if (x <= 2 && y <= 2) std::cout <<  x << "|" << y << " --To-- " << h-y << "|" << x << std::endl;
-                DitherImage_set_pixel(dither_image, h-y, x, r, g, b, true);
+
+    uint8_t *out_image = (uint8_t*) calloc((size_t) dots * scaled_total, sizeof(uint8_t));
+    if (out_image == nullptr) return nullptr;
+    ErrorDiffusionMatrix *em = get_robert_kist_matrix();
+    // a tile starts and ends in the white gap between the shots, so there is no error to carry over
+    std::atomic<int> next_tile(0);
+    std::atomic<bool> failed(false);
+    auto work = [&]() {
+        for (int i = next_tile++; i < (int) tiles.size(); i = next_tile++) {
+            int y = 0;
+            for (int j = 0; j < i; j++) y += tiles[j].rows;
+            const PrintTile &tile = tiles[i];
+            SDL_Surface *view = SDL_CreateSurfaceFrom(capture_surface->w, tile.rows, capture_surface->format,
+                                                      (uint8_t*) capture_surface->pixels + (size_t) y * capture_surface->pitch,
+                                                      capture_surface->pitch);
+            // every shot gets its own auto tone, the white gaps around it would only skew the histogram
+            SDL_Rect shot = {.x = tile.shot_x, .y = tile.shot_y, .w = tile.shot_w, .h = tile.shot_h};
+            DitherImage *dither_image = view != nullptr ? createDitherImage(view, &portrait, dots, &shot) : nullptr;
+            if (view != nullptr) SDL_DestroySurface(view);
+            if (dither_image == nullptr || dither_image->width != dots || dither_image->height != scaled_rows[i]) {
+                failed = true;
             } else {
-                DitherImage_set_pixel(dither_image, x, y, r, g, b, true);
+                fast_error_diffusion_dither(dither_image, em, false, out_image + (size_t) scaled_y[i] * dots);
             }
+            if (dither_image != nullptr) DitherImage_free(dither_image);
         }
+    };
+    int thread_count = std::min(ditherThreads(), (int) tiles.size());
+    std::vector<std::thread> threads;
+    for (int i = 1; i < thread_count; i++) threads.emplace_back(work);
+    work();
+    for (std::thread &thread : threads) thread.join();
+    ErrorDiffusionMatrix_free(em);
+
+    if (failed) {
+        std::cerr << "ERROR: could not dither print tiles" << std::endl;
+        free(out_image);
+        return nullptr;
     }
-    uint8_t *out_image = (uint8_t*)calloc(w * h, sizeof(uint8_t));
+    *width = dots;
+    *height = scaled_total;
+    return out_image;
+}
+
+bool Printer::printSdlSurfaceBanded(SDL_Surface *capture_surface, PrintSettings *print_set,
+                                    const LayoutRaster *layout, std::function<void()> on_first_band) {
+    DitherImage* dither_image = createDitherImage(capture_surface, print_set,
+                                                  layout != nullptr ? layout->photo_width : PRINT_WIDTH);
+    if (dither_image == nullptr) return false;
+    int width = dither_image->width;
+    int height = dither_image->height;
+    int band_height = print_set->band_height > 0 ? print_set->band_height : height;
+    uint8_t *out_image = (uint8_t*)calloc(width * height, sizeof(uint8_t));
     ErrorDiffusionMatrix *em = get_robert_kist_matrix();
-    error_diffusion_dither(dither_image, em, false, 0.0, out_image);
-    // dbs_dither(dither_image, 3, out_image);
-    printDitheredImage(out_image, dither_image->width, dither_image->height);
-    
+    FastErrorDiffusionState *state = FastErrorDiffusionState_new(dither_image, em, false);
+    FastErrorDiffusionState_set_threads(state, ditherThreads());
+
+    // the whole job lives in one arena that does not move, so the transport sends
+    // band N on its own thread while band N+1 is dithered and packed behind it
+    int bands = (height + band_height - 1) / band_height;
+    int raster_width = layout != nullptr ? PRINT_WIDTH : width;
+    beginJob((size_t) bands * EscPosJob::RASTER_HEADER_SIZE + (size_t) ((raster_width + 7) / 8) * height, layout);
+    uint64_t ticket = 0;
+    int err = 0;
+    int band = 0;
+    for (int y = 0; y < height && !err; band++) {
+        int rows = fast_error_diffusion_dither_rows(state, band_height, out_image);
+        appendPhoto(out_image + (size_t) y * width, width, rows, layout);
+        y += rows;
+        if (y >= height) endJob(layout); // the layout below the photo and the trailing commands go out with the last band
+
+        if (band == 0 && on_first_band) on_first_band();
+        if (job.failed()) { // the bands already sent are not followed by the rest
+            err = 1;
+            break;
+        }
+        ticket = flush();
+        if (ticket == 0) err = 1;
+    }
+    if (!err && !transport.wait(ticket, SEND_TIMEOUT_MS)) err = 1;
+    if (err) {
+		std::cerr << "ERROR: could not write to open usb device." << std::endl;
+        transport.cancel();
+    }
+
+    FastErrorDiffusionState_free(state);
     ErrorDiffusionMatrix_free(em);
+    DitherImage_free(dither_image);
     free(out_image);
-    SDL_DestroySurface(scaled_surface);
+    return !err;
 }
 
 // void Printer::printBitmap(std::vector< std::vector<bool> > &bitmap) {
@@ -1,10 +1,16 @@
 #ifndef KB_PRINTER_H
 #define KB_PRINTER_H
 #include <vector>
+#include <functional>
 #include "libusb.h"
 #include "stb_image.h"
 #include <SDL3/SDL.h>
 #include "Kbooth.h"
+#include "EscPosJob.h"
+#include "PrintLayout.h"
+#include "RasterPacker.h"
+#include "UsbTransport.h"
+#include "libdither.h"
 
 namespace Kbooth {
 
@@ -14,10 +20,30 @@ namespace Kbooth {
         bool initialized = false;
         std::vector<UsbDevice> usb_devices;
 		libusb_device_handle *handle;
+        static const unsigned char ENDPOINT = 0x01;
+        static const unsigned int SEND_TIMEOUT_MS = 10000; // without any progress means the printer stalled
+        UsbTransport transport;
+        static const size_t JOB_COMMAND_BYTES = 64; // room for the commands around the raster
+        EscPosJob job; // reused between prints
 
-		int send_command(std::vector<unsigned char> command);
-		int cut();
+        // scaled to dots wide, gray, linear copy of the surface with auto tone and sharpening applied, nullptr on failure;
+        // a portrait image can be toned within tone_region (surface pixels) only, nullptr tones all of it
+        static DitherImage *createDitherImage(SDL_Surface *capture_surface, PrintSettings *print_set, int dots,
+                                              const SDL_Rect *tone_region = nullptr);
+
+		int send_command(const unsigned char *data, int length);
+        // hands the unflushed part of the job to the transport, returns the ticket (0 on failure)
+        uint64_t flush();
+        // raster_bytes of the photo; the bands of the layout above the photo come first, layout may be nullptr
+        void beginJob(size_t raster_bytes, const LayoutRaster *layout);
+        // appends the bands of the layout below the photo and the trailing commands
+        void endJob(const LayoutRaster *layout);
+        void appendBands(const std::vector<RasterBand> &bands);
+        // raster block of rows dithered photo rows, placed into the frame of the layout
+        void appendPhoto(const uint8_t *image, int width, int rows, const LayoutRaster *layout);
     public:
+        static const int PRINT_WIDTH = 576; // dots per line
+
         bool init();
         std::vector<UsbDevice>* getAvailUsbDevices();
         bool open(UsbDevice& dev);
@@ -25,8 +51,35 @@ namespace Kbooth {
         bool initAndOpen(UsbDevice *default_dev);
         void cleanup();
 
-        void printSdlSurface(SDL_Surface *capture_surface, PrintSettings *print_set);
-		void printDitheredImage(uint8_t *image, int width, int height);
+        bool printSdlSurface(SDL_Surface *capture_surface, PrintSettings *print_set);
+        // scaled to dots across the paper, returns a width x height buffer with one byte per pixel (0xff = white),
+        // free() it when done; nullptr on failure
+        static uint8_t *ditherSdlSurface(SDL_Surface *capture_surface, PrintSettings *print_set, int dots,
+                                         int *width, int *height);
+        /**
+         * @brief Like ditherSdlSurface, but dithers the horizontal tiles of
+         * the surface independently, one thread per tile.
+         *
+         * tiles go from the top and their rows sum up to the surface height,
+         * e.g. the shots of a photo strip. Each tile gets its own auto tone,
+         * taken from its shot only. Every tile is scaled to dots wide by
+         * itself. The surface is always printed in portrait; when the
+         * tiles do not add up it is dithered as a whole.
+         */
+        uint8_t *ditherSdlSurfaceTiled(SDL_Surface *capture_surface, PrintSettings *print_set,
+                                       const std::vector<PrintTile> &tiles, int dots, int *width, int *height);
+		// sends the image in the photo region of layout, nullptr sends it alone
+		bool printDitheredImage(uint8_t *image, int width, int height, const LayoutRaster *layout);
+        /**
+         * @brief Dithers and sends the surface in bands of print_set->band_height rows.
+         *
+         * Each band is its own GS v 0 raster block in the print job and goes
+         * out on the transport thread while the next one is dithered.
+         * on_first_band is called right before the first band is sent. The
+         * photo is scaled to the photo region of layout, which may be nullptr.
+         */
+        bool printSdlSurfaceBanded(SDL_Surface *capture_surface, PrintSettings *print_set,
+                                   const LayoutRaster *layout, std::function<void()> on_first_band);
 
 		~Printer();	
     };
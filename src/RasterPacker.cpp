@@ -0,0 +1,68 @@
+#include "RasterPacker.h"
+#include "Simd.h"
+
+using namespace Kbooth;
+
+#if defined(KB_SIMD_SSE2)
+// movemask puts the leftmost pixel into bit 0, the printer wants it in bit 7
+static unsigned char reversed_bits[256];
+static bool reversed_bits_ready = [] {
+    for (int i = 0; i < 256; i++) {
+        unsigned char r = 0;
+        for (int b = 0; b < 8; b++) {
+            if (i & (1 << b)) r |= (unsigned char) (0x80 >> b);
+        }
+        reversed_bits[i] = r;
+    }
+    return true;
+}();
+#endif
+
+void RasterPacker::packRow(const uint8_t *src, int width, unsigned char *dst) {
+    int x = 0;
+#if defined(KB_SIMD_SSE2)
+    const __m128i white = _mm_set1_epi8((char) 0xff);
+    for (; x + 16 <= width; x += 16) {
+        __m128i px = _mm_loadu_si128((const __m128i *) (src + x));
+        int black = ~_mm_movemask_epi8(_mm_cmpeq_epi8(px, white));
+        *dst++ = reversed_bits[black & 0xff];
+        *dst++ = reversed_bits[(black >> 8) & 0xff];
+    }
+#elif defined(KB_SIMD_NEON)
+    const uint8x16_t white = vdupq_n_u8(0xff);
+    const uint8_t weights_arr[16] = {128, 64, 32, 16, 8, 4, 2, 1, 128, 64, 32, 16, 8, 4, 2, 1};
+    const uint8x16_t weights = vld1q_u8(weights_arr);
+    for (; x + 16 <= width; x += 16) {
+        uint8x16_t black = vmvnq_u8(vceqq_u8(vld1q_u8(src + x), white));
+        uint8x16_t bits = vandq_u8(black, weights);
+        // three pairwise adds fold each half into a single byte
+        uint8x8_t sum = vpadd_u8(vget_low_u8(bits), vget_high_u8(bits));
+        sum = vpadd_u8(sum, sum);
+        sum = vpadd_u8(sum, sum);
+        *dst++ = vget_lane_u8(sum, 0);
+        *dst++ = vget_lane_u8(sum, 1);
+    }
+#endif
+    for (; x + 8 <= width; x += 8) {
+        const uint8_t *p = src + x;
+        *dst++ = (unsigned char) (
+            ((p[0] != 0xff) << 7) | ((p[1] != 0xff) << 6) |
+            ((p[2] != 0xff) << 5) | ((p[3] != 0xff) << 4) |
+            ((p[4] != 0xff) << 3) | ((p[5] != 0xff) << 2) |
+            ((p[6] != 0xff) << 1) | (p[7] != 0xff));
+    }
+    if (x < width) { // last partial byte, padded with white
+        unsigned char d_k = 0;
+        for (int c = 0; x < width; c++, x++) {
+            if (src[x] != 0xff) d_k |= (unsigned char) (1 << (7 - c));
+        }
+        *dst = d_k;
+    }
+}
+
+void RasterPacker::packRows(const uint8_t *image, int width, int height, unsigned char *dst) {
+    int width_bytes = (width + 7) / 8;
+    for (int y = 0; y < height; y++, dst += width_bytes) {
+        packRow(image + (size_t) y * width, width, dst);
+    }
+}
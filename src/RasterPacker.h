@@ -0,0 +1,23 @@
+#ifndef KB_RASTER_PACKER_H
+#define KB_RASTER_PACKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Kbooth {
+
+    /**
+     * Packs 1-byte-per-pixel dither output (0xff = white, everything else
+     * black) into GS v 0 raster rows: ceil(width / 8) bytes per row,
+     * MSB = leftmost dot. The destination is usually the row storage
+     * returned by EscPosJob::raster().
+     */
+    struct RasterPacker {
+        // packs one row of width pixels into ceil(width / 8) bytes at dst
+        static void packRow(const uint8_t *src, int width, unsigned char *dst);
+        // packs height rows of width pixels, rows are stored back to back
+        static void packRows(const uint8_t *image, int width, int height, unsigned char *dst);
+    };
+}
+
+#endif // KB_RASTER_PACKER_H
@@ -0,0 +1,137 @@
+#include "Sharpness.h"
+#include "Simd.h"
+
+#include <stdint.h>
+
+using namespace Kbooth;
+
+// gray samples of a frame, every stride-th byte of a row
+struct GrayView {
+    const Uint8 *base;
+    int pitch;
+    int stride;
+    int w;
+    int h;
+};
+
+// luma where there is one, green for rgb, which is close enough for a sharpness measure
+static bool grayView(const CameraFrame *frame, GrayView *view) {
+    const Uint8 *luma = frame->lumaPlane();
+    if (luma != nullptr) {
+        *view = {luma, frame->pitch, 1, frame->w, frame->h};
+        return true;
+    }
+    const Uint8 *pixels = frame->pixels.data();
+    switch (frame->format) {
+        case SDL_PIXELFORMAT_MJPG: // the RGBX32 preview, the compressed data is not decoded again
+            if (frame->preview.empty()) return false;
+            *view = {frame->preview.data() + 1, frame->preview_pitch, 4, frame->preview_w, frame->preview_h};
+            return true;
+        case SDL_PIXELFORMAT_YUY2:
+        case SDL_PIXELFORMAT_YVYU:
+            *view = {pixels, frame->pitch, 2, frame->w, frame->h};
+            return true;
+        case SDL_PIXELFORMAT_UYVY:
+            *view = {pixels + 1, frame->pitch, 2, frame->w, frame->h};
+            return true;
+        case SDL_PIXELFORMAT_RGBA32:
+        case SDL_PIXELFORMAT_BGRA32:
+        case SDL_PIXELFORMAT_RGBX32:
+        case SDL_PIXELFORMAT_BGRX32:
+            *view = {pixels + 1, frame->pitch, 4, frame->w, frame->h};
+            return true;
+        case SDL_PIXELFORMAT_ARGB32:
+        case SDL_PIXELFORMAT_ABGR32:
+        case SDL_PIXELFORMAT_XRGB32:
+        case SDL_PIXELFORMAT_XBGR32:
+            *view = {pixels + 2, frame->pitch, 4, frame->w, frame->h};
+            return true;
+        case SDL_PIXELFORMAT_RGB24:
+        case SDL_PIXELFORMAT_BGR24:
+            *view = {pixels + 1, frame->pitch, 3, frame->w, frame->h};
+            return true;
+        default:
+            return false;
+    }
+}
+
+float Sharpness::score(const CameraFrame *frame, std::vector<unsigned char> *scratch) {
+    GrayView view;
+    if (frame == nullptr || frame->sequence == 0 || !grayView(frame, &view)) return -1.0f;
+    int step = (view.w + SAMPLE_WIDTH - 1) / SAMPLE_WIDTH;
+    if (step < 1) step = 1;
+    int w = view.w / step, h = view.h / step;
+    if (w < 3 || h < 3) return -1.0f;
+    if (scratch->size() < (size_t) w * h) scratch->resize((size_t) w * h);
+
+    // 2x2 average at every step-th pixel: removes sensor noise, but keeps the edges the metric looks for
+    unsigned char *dst = scratch->data();
+    int next_x = step > 1 ? view.stride : 0;
+    int next_y = step > 1 ? view.pitch : 0;
+    for (int y = 0; y < h; y++) {
+        const Uint8 *row = view.base + (size_t) y * step * view.pitch;
+        for (int x = 0; x < w; x++, dst++) {
+            const Uint8 *p = row + (size_t) x * step * view.stride;
+            *dst = (unsigned char) ((p[0] + p[next_x] + p[next_y] + p[next_y + next_x] + 2) >> 2);
+        }
+    }
+    return laplacianVariance(scratch->data(), w, h);
+}
+
+float Sharpness::laplacianVariance(const unsigned char *gray, int w, int h) {
+    if (w < 3 || h < 3) return 0.0f;
+    int64_t sum = 0, sum_sq = 0;
+    for (int y = 1; y < h - 1; y++) {
+        const unsigned char *up = gray + (size_t) (y - 1) * w;
+        const unsigned char *mid = up + w;
+        const unsigned char *down = mid + w;
+        int x = 1;
+        // laplacians fit in 16 bits (|4c - l - r - u - d| <= 1020), rows of SAMPLE_WIDTH in 32 bit sums
+#if defined(KB_SIMD_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ones = _mm_set1_epi16(1);
+        __m128i row_sum = zero, row_sq = zero;
+        for (; x + 8 <= w - 1; x += 8) {
+            __m128i c = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (mid + x)), zero);
+            __m128i l = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (mid + x - 1)), zero);
+            __m128i r = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (mid + x + 1)), zero);
+            __m128i u = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (up + x)), zero);
+            __m128i d = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (down + x)), zero);
+            __m128i lap = _mm_sub_epi16(_mm_slli_epi16(c, 2),
+                                        _mm_add_epi16(_mm_add_epi16(l, r), _mm_add_epi16(u, d)));
+            row_sum = _mm_add_epi32(row_sum, _mm_madd_epi16(lap, ones));
+            row_sq = _mm_add_epi32(row_sq, _mm_madd_epi16(lap, lap));
+        }
+        int32_t lanes[4];
+        _mm_storeu_si128((__m128i *) lanes, row_sum);
+        sum += (int64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        _mm_storeu_si128((__m128i *) lanes, row_sq);
+        sum_sq += (int64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(KB_SIMD_NEON)
+        int32x4_t row_sum = vdupq_n_s32(0), row_sq = vdupq_n_s32(0);
+        for (; x + 8 <= w - 1; x += 8) {
+            int16x8_t c = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(mid + x)));
+            int16x8_t l = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(mid + x - 1)));
+            int16x8_t r = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(mid + x + 1)));
+            int16x8_t u = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(up + x)));
+            int16x8_t d = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(down + x)));
+            int16x8_t lap = vsubq_s16(vshlq_n_s16(c, 2), vaddq_s16(vaddq_s16(l, r), vaddq_s16(u, d)));
+            row_sum = vpadalq_s16(row_sum, lap);
+            row_sq = vmlal_s16(row_sq, vget_low_s16(lap), vget_low_s16(lap));
+            row_sq = vmlal_s16(row_sq, vget_high_s16(lap), vget_high_s16(lap));
+        }
+        sum += (int64_t) vgetq_lane_s32(row_sum, 0) + vgetq_lane_s32(row_sum, 1) +
+               vgetq_lane_s32(row_sum, 2) + vgetq_lane_s32(row_sum, 3);
+        sum_sq += (int64_t) vgetq_lane_s32(row_sq, 0) + vgetq_lane_s32(row_sq, 1) +
+                  vgetq_lane_s32(row_sq, 2) + vgetq_lane_s32(row_sq, 3);
+#endif
+        for (; x < w - 1; x++) {
+            int lap = 4 * mid[x] - mid[x - 1] - mid[x + 1] - up[x] - down[x];
+            sum += lap;
+            sum_sq += lap * lap;
+        }
+    }
+    double n = (double) (w - 2) * (h - 2);
+    double mean = (double) sum / n;
+    return (float) ((double) sum_sq / n - mean * mean);
+}
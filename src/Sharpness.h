@@ -0,0 +1,25 @@
+#ifndef KB_SHARPNESS_H
+#define KB_SHARPNESS_H
+
+#include <SDL3/SDL.h>
+#include <vector>
+#include "CameraCapture.h"
+
+namespace Kbooth {
+
+    /**
+     * Focus and motion blur measure of camera frames: the variance of the
+     * Laplacian of the luma, downsampled to at most SAMPLE_WIDTH columns.
+     * Only comparable between frames of the same camera and format.
+     */
+    struct Sharpness {
+        static const int SAMPLE_WIDTH = 320; // also keeps the 32 bit row sums of the simd loop from overflowing
+
+        // higher is sharper, < 0 if the format is not supported; scratch is reused between calls
+        static float score(const CameraFrame *frame, std::vector<unsigned char> *scratch);
+        // variance of the 4-neighbour Laplacian over the inner pixels of a w x h gray image, rows back to back
+        static float laplacianVariance(const unsigned char *gray, int w, int h);
+    };
+}
+
+#endif // KB_SHARPNESS_H
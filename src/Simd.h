@@ -0,0 +1,17 @@
+#ifndef KB_SIMD_H
+#define KB_SIMD_H
+// Compile time selection of the vector instruction set used by the image
+// and raster loops. Everything has a scalar fallback.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define KB_SIMD_SSE2 1
+    #include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define KB_SIMD_NEON 1
+    #if defined(__aarch64__)
+        #define KB_SIMD_NEON_A64 1 // 64 byte table lookups (vqtbl4q_u8)
+    #endif
+    #include <arm_neon.h>
+#endif
+
+#endif // KB_SIMD_H
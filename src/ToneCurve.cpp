@@ -0,0 +1,109 @@
+#include "ToneCurve.h"
+#include "Simd.h"
+
+#include <math.h>
+#include <string.h>
+
+using namespace Kbooth;
+
+ToneCurve::ToneCurve() {
+    for (int i = 0; i < 256; i++) lut[i] = (unsigned char) i;
+}
+
+ToneCurve::ToneCurve(const PrintSettings *print_set) {
+    // like the old per pixel adjustment, the curve never goes fully black
+    const float MIN_OUTPUT = 10.0f;
+    float black = (float) print_set->black_level;
+    float white = (float) print_set->white_level;
+    if (white <= black) white = black + 1.0f;
+    float inverse_gamma = print_set->gamma > 0.0f ? 1.0f / print_set->gamma : 1.0f;
+    for (int i = 0; i < 256; i++) {
+        float level = fminf(fmaxf((i - black) / (white - black), 0.0f), 1.0f);
+        float value = 255.0f * powf(level, inverse_gamma);
+        value = print_set->contrast * (value - 128.0f) + 128.0f + print_set->brightness;
+        lut[i] = (unsigned char) fminf(fmaxf(value, MIN_OUTPUT), 255.0f);
+    }
+}
+
+ToneCurve::ToneCurve(const unsigned char *table) {
+    memcpy(lut, table, sizeof(lut));
+}
+
+bool ToneCurve::isIdentity() const {
+    for (int i = 0; i < 256; i++) {
+        if (lut[i] != i) return false;
+    }
+    return true;
+}
+
+#if defined(KB_SIMD_NEON_A64)
+struct NeonTable {
+    uint8x16x4_t quarters[4];
+};
+
+static void loadTable(const unsigned char *lut, NeonTable *table) {
+    for (int q = 0; q < 4; q++) {
+        for (int k = 0; k < 4; k++) table->quarters[q].val[k] = vld1q_u8(lut + q * 64 + k * 16);
+    }
+}
+
+// TBL gives 0 for indices past its 64 bytes, so the four quarters can be or-ed together
+static inline uint8x16_t lookup(const NeonTable &table, uint8x16_t v) {
+    const uint8x16_t quarter = vdupq_n_u8(64);
+    uint8x16_t r = vqtbl4q_u8(table.quarters[0], v);
+    v = vsubq_u8(v, quarter);
+    r = vorrq_u8(r, vqtbl4q_u8(table.quarters[1], v));
+    v = vsubq_u8(v, quarter);
+    r = vorrq_u8(r, vqtbl4q_u8(table.quarters[2], v));
+    v = vsubq_u8(v, quarter);
+    return vorrq_u8(r, vqtbl4q_u8(table.quarters[3], v));
+}
+#endif
+
+void ToneCurve::applyGray(const uint8_t *src, uint8_t *dst, size_t count) const {
+    size_t i = 0;
+#if defined(KB_SIMD_NEON_A64)
+    NeonTable table;
+    loadTable(lut, &table);
+    for (; i + 16 <= count; i += 16) vst1q_u8(dst + i, lookup(table, vld1q_u8(src + i)));
+#endif
+    // sse2 and 32 bit neon have no byte table lookup of this size, plain loads are as fast
+    for (; i + 4 <= count; i += 4) {
+        uint8_t a = lut[src[i]], b = lut[src[i + 1]], c = lut[src[i + 2]], d = lut[src[i + 3]];
+        dst[i] = a;
+        dst[i + 1] = b;
+        dst[i + 2] = c;
+        dst[i + 3] = d;
+    }
+    for (; i < count; i++) dst[i] = lut[src[i]];
+}
+
+void ToneCurve::applyRGBA(const uint8_t *src, int src_pitch, uint8_t *dst, int dst_pitch, int w, int h) const {
+#if defined(KB_SIMD_NEON_A64)
+    NeonTable table;
+    loadTable(lut, &table);
+#endif
+    for (int y = 0; y < h; y++) {
+        const uint8_t *s = src + (size_t) y * src_pitch;
+        uint8_t *d = dst + (size_t) y * dst_pitch;
+        int x = 0;
+#if defined(KB_SIMD_NEON_A64)
+        for (; x + 16 <= w; x += 16) {
+            uint8x16x4_t px = vld4q_u8(s + x * 4);
+            px.val[0] = lookup(table, px.val[0]);
+            px.val[1] = lookup(table, px.val[1]);
+            px.val[2] = lookup(table, px.val[2]);
+            vst4q_u8(d + x * 4, px);
+        }
+#endif
+        for (; x < w; x++) {
+            const uint8_t *p = s + x * 4;
+            uint8_t *q = d + x * 4;
+            uint8_t r = lut[p[0]], g = lut[p[1]], b = lut[p[2]];
+            q[0] = r;
+            q[1] = g;
+            q[2] = b;
+            q[3] = p[3];
+        }
+    }
+}
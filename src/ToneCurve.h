@@ -0,0 +1,34 @@
+#ifndef KB_TONE_CURVE_H
+#define KB_TONE_CURVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Kbooth.h"
+
+namespace Kbooth {
+
+    /**
+     * Input levels, gamma, contrast and brightness of the print settings
+     * compiled into one 256 entry table. Applying it is a single lookup
+     * per channel and never touches the source, so the same curve can be
+     * used for the print and for a preview of it.
+     */
+    class ToneCurve {
+    private:
+        unsigned char lut[256];
+    public:
+        ToneCurve(); // identity
+        explicit ToneCurve(const PrintSettings *print_set);
+        explicit ToneCurve(const unsigned char *table); // copies 256 entries
+
+        bool isIdentity() const;
+        const unsigned char *table() const { return lut; }
+
+        // count gray bytes from src to dst, dst may be src
+        void applyGray(const uint8_t *src, uint8_t *dst, size_t count) const;
+        // w x h RGBA32 pixels from src to dst, alpha is copied unchanged; dst may be src
+        void applyRGBA(const uint8_t *src, int src_pitch, uint8_t *dst, int dst_pitch, int w, int h) const;
+    };
+}
+
+#endif // KB_TONE_CURVE_H
@@ -0,0 +1,50 @@
+#ifndef KB_TRIPLE_BUFFER_H
+#define KB_TRIPLE_BUFFER_H
+
+#include <atomic>
+
+namespace Kbooth {
+
+    /**
+     * Lock-free single producer / single consumer triple buffer.
+     *
+     * The producer fills writeBuffer() and publishes it, the consumer picks
+     * up the newest published buffer with update() and reads readBuffer().
+     * Neither side ever waits: the producer overwrites frames the consumer
+     * skipped, and each side only touches its own slot.
+     */
+    template <typename T>
+    class TripleBuffer {
+    private:
+        static const unsigned char INDEX_MASK = 0x3;
+        static const unsigned char FRESH = 0x4; // the shared slot holds an unread buffer
+
+        T slots[3]{};
+        int write_index;
+        int read_index;
+        std::atomic<unsigned char> shared; // index of the slot in between, plus FRESH
+
+    public:
+        TripleBuffer() : write_index(0), read_index(1), shared(2) {}
+
+        // producer side
+        T &writeBuffer() { return slots[write_index]; }
+        void publish() {
+            unsigned char previous = shared.exchange((unsigned char) (write_index | FRESH), std::memory_order_acq_rel);
+            write_index = previous & INDEX_MASK;
+        }
+
+        // consumer side; returns true if a newer buffer was swapped in
+        bool update() {
+            if (!(shared.load(std::memory_order_relaxed) & FRESH)) return false;
+            unsigned char previous = shared.exchange((unsigned char) read_index, std::memory_order_acq_rel);
+            read_index = previous & INDEX_MASK;
+            return true;
+        }
+        T &readBuffer() { return slots[read_index]; }
+        // whether update() would swap in a newer buffer
+        bool hasFresh() const { return shared.load(std::memory_order_relaxed) & FRESH; }
+    };
+}
+
+#endif // KB_TRIPLE_BUFFER_H
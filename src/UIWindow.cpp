@@ -1,6 +1,8 @@
 #include "UIWindow.h"
 
 #include "Kbooth.h"
+#include "PrintLayout.h"
+#include "UnsharpMask.h"
 #include "imgui_internal.h"
 #include "imgui.h"
 #include "imgui_impl_sdl3.h"
@@ -18,8 +20,9 @@ using namespace Kbooth;
 void free_formats(const char **formats, int size);
 
 UIWindow::UIWindow(SDL_Window *window, SDL_Renderer *renderer, Settings *settings,
-                   Camera *camera, std::vector<UsbDevice> *usb_devices)
-    : renderer(renderer), settings(settings), window(window), camera(camera), printer_usb_devices(usb_devices) {
+                   Camera *camera, PrintWorker *print_worker, std::vector<UsbDevice> *usb_devices)
+    : renderer(renderer), settings(settings), window(window), camera(camera), print_worker(print_worker),
+      printer_usb_devices(usb_devices) {
 
 	//get available cameras
 	cameras = this->camera->getAvailCameraNames(&cameras_size);
@@ -34,9 +37,11 @@ UIWindow::UIWindow(SDL_Window *window, SDL_Renderer *renderer, Settings *setting
 	settings_opened = false;
     settings_button_visible = false;
 	ui_visible = true;
+	stats_visible = false;
 	alpha = 0.96;
 
     countdown_status = camera->getCountdownStatus();
+    print_status_shown = false;
 
     printer_usb_device_index = 0;
     printer_usb_device_set_as_default = false;
@@ -99,6 +104,17 @@ void UIWindow::processEvent(SDL_Event *event) {
 	if (event->type == SDL_EVENT_KEY_DOWN && event->key.key == SDLK_S) {
 		settings_button_visible = !settings_button_visible;
 	}
+	if (event->type == SDL_EVENT_KEY_DOWN && event->key.key == SDLK_L) {
+		stats_visible = !stats_visible;
+	}
+	if (event->type == SDL_EVENT_CAMERA_DEVICE_ADDED || event->type == SDL_EVENT_CAMERA_DEVICE_REMOVED) {
+		// the names of a removed camera are freed by SDL
+		delete[] cameras;
+		cameras = camera->getAvailCameraNames(&cameras_size);
+		if (camera_index >= cameras_size) camera_index = 0;
+		free_formats(formats, formats_size);
+		formats = camera->getAvailFormatNames(camera_index, &formats_size);
+	}
 }
 
 void UIWindow::render() {
@@ -112,6 +128,7 @@ void UIWindow::render() {
     if (settings_opened) renderSettingsWindow();
     style.Alpha = 1.0f;
     if (ui_visible) renderGlobalButtons();
+    if (stats_visible) renderFrameStats();
 
     ImGui::Render();
     ImGui_ImplSDLRenderer3_RenderDrawData(ImGui::GetDrawData(), renderer);
@@ -207,6 +224,29 @@ void UIWindow::fontSelector() {
     }
 }
 
+void UIWindow::layoutSelector() {
+    static std::vector<std::string> layouts;
+
+    // the templates are only listed once, the camera loads the selected one with the next print
+    if (layouts.empty()) {
+        std::error_code error;
+        for (const auto& entry : fs::directory_iterator(PrintLayout::DIRECTORY, error)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".ini") {
+                layouts.push_back(entry.path().stem().string());
+            }
+        }
+    }
+    std::string &current = settings->print_settings.layout;
+    if (ImGui::BeginCombo("Print Layout", current.c_str())) {
+        for (const std::string &layout : layouts) {
+            bool isSelected = layout == current;
+            if (ImGui::Selectable(layout.c_str(), isSelected)) current = layout;
+            if (isSelected) ImGui::SetItemDefaultFocus();
+        }
+        ImGui::EndCombo();
+    }
+}
+
 void UIWindow::renderGlobalButtons() {
 	ImGui::PushFont(font_regular);
     // Settings Button
@@ -227,7 +267,7 @@ void UIWindow::renderGlobalButtons() {
         ImGui::End();
     }
 
-	if (!(*countdown_status)) {
+	if (!(*countdown_status) && camera->getState() == CameraState::Streaming) {
 		// Take Picture Button
 		ImVec2 display_size = ImGui::GetIO().DisplaySize;
 		ImVec2 button_size = ImVec2(display_size.y / 4.0f, display_size.y / 4.0f);
@@ -251,9 +291,125 @@ void UIWindow::renderGlobalButtons() {
 		ImGui::End();
 	}
 
+    renderPrintStatus();
+    renderCameraStatus();
     ImGui::PopFont();
 }
 
+bool UIWindow::printStatusVisible(const PrintJobStatus &status) {
+    if (status.state == PrintJobState::Idle) return false;
+    // finished jobs stay visible for a few seconds
+    bool finished = status.state == PrintJobState::Done || status.state == PrintJobState::Failed;
+    return !finished || SDL_GetTicks() - status.updated_at <= 4000;
+}
+
+bool UIWindow::needsRedraw() {
+    if (!ui_visible) return false;
+    if (settings_opened) return true; // sliders edit the framing of the live preview
+    if (print_worker == nullptr) return false;
+    PrintJobStatus status = print_worker->getStatus();
+    if (printStatusVisible(status) != print_status_shown) return true;
+    return print_status_shown &&
+        (status.job_id != shown_status.job_id ||
+         status.state != shown_status.state ||
+         status.queued != shown_status.queued);
+}
+
+void UIWindow::renderPrintStatus() {
+    print_status_shown = false;
+    if (print_worker == nullptr) return;
+    PrintJobStatus status = print_worker->getStatus();
+    if (!printStatusVisible(status)) return;
+    shown_status = status;
+    print_status_shown = true;
+    const char *state_text;
+    switch (status.state) {
+        case PrintJobState::Queued:    state_text = "Queued"; break;
+        case PrintJobState::Saving:    state_text = "Saving"; break;
+        case PrintJobState::Dithering: state_text = "Preparing"; break;
+        case PrintJobState::Sending:   state_text = "Printing"; break;
+        case PrintJobState::Done:      state_text = "Done"; break;
+        case PrintJobState::Failed:    state_text = "Failed"; break;
+        default: return;
+    }
+    ImVec2 display_size = ImGui::GetIO().DisplaySize;
+    ImGui::SetNextWindowPos(ImVec2(display_size.x - 10.0f, 10.0f), ImGuiCond_Always, ImVec2(1.0f, 0.0f));
+    ImGui::Begin("Print_Status", NULL,
+                 ImGuiWindowFlags_NoTitleBar |
+                 ImGuiWindowFlags_NoDecoration |
+                 ImGuiWindowFlags_NoMove |
+                 ImGuiWindowFlags_NoResize |
+                 ImGuiWindowFlags_AlwaysAutoResize |
+                 ImGuiWindowFlags_NoFocusOnAppearing |
+                 ImGuiWindowFlags_NoNav);
+    if (status.state == PrintJobState::Failed) {
+        ImGui::TextColored(kbooth_primary_color, "Print #%d: %s", status.job_id, state_text);
+    } else {
+        ImGui::Text("Print #%d: %s", status.job_id, state_text);
+    }
+    if (status.queued > 0) ImGui::Text("%d waiting", status.queued);
+    ImGui::End();
+}
+
+
+void UIWindow::renderCameraStatus() {
+    const char *status_text;
+    switch (camera->getState()) {
+        case CameraState::Closed:
+        case CameraState::Disconnected: status_text = "Please connect the camera"; break;
+        case CameraState::WaitingForPermission: status_text = "Waiting for camera permission"; break;
+        case CameraState::Denied: status_text = "Camera access denied"; break;
+        default: return;
+    }
+    ImVec2 display_size = ImGui::GetIO().DisplaySize;
+    ImGui::SetNextWindowPos(ImVec2(display_size.x / 2.0f, display_size.y * 0.8f), ImGuiCond_Always, ImVec2(0.5f, 0.5f));
+    ImGui::Begin("Camera_Status", NULL,
+                 ImGuiWindowFlags_NoDecoration |
+                 ImGuiWindowFlags_NoBackground |
+                 ImGuiWindowFlags_NoMove |
+                 ImGuiWindowFlags_NoInputs |
+                 ImGuiWindowFlags_AlwaysAutoResize |
+                 ImGuiWindowFlags_NoFocusOnAppearing |
+                 ImGuiWindowFlags_NoNav);
+    ImGui::TextUnformatted(status_text);
+    ImGui::End();
+}
+
+void UIWindow::renderFrameStats() {
+    FrameStats *stats = camera->getFrameStats();
+    ImVec2 display_size = ImGui::GetIO().DisplaySize;
+    ImGui::SetNextWindowPos(ImVec2(10.0f, display_size.y - 10.0f), ImGuiCond_Always, ImVec2(0.0f, 1.0f));
+    ImGui::SetNextWindowBgAlpha(0.6f);
+    ImGui::Begin("Frame_Stats", NULL,
+                 ImGuiWindowFlags_NoDecoration |
+                 ImGuiWindowFlags_NoMove |
+                 ImGuiWindowFlags_NoInputs |
+                 ImGuiWindowFlags_AlwaysAutoResize |
+                 ImGuiWindowFlags_NoFocusOnAppearing |
+                 ImGuiWindowFlags_NoNav);
+    if (ImGui::BeginTable("Latencies", 4)) {
+        ImGui::TableSetupColumn("ms");
+        ImGui::TableSetupColumn("p50");
+        ImGui::TableSetupColumn("p95");
+        ImGui::TableSetupColumn("p99");
+        ImGui::TableHeadersRow();
+        for (int i = 0; i < FrameStats::STAGE_COUNT; i++) {
+            FrameStats::Stage stage = (FrameStats::Stage) i;
+            float p50, p95, p99;
+            if (!stats->percentiles(stage, &p50, &p95, &p99)) continue;
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn(); ImGui::TextUnformatted(FrameStats::stageName(stage));
+            ImGui::TableNextColumn(); ImGui::Text("%.1f", p50);
+            ImGui::TableNextColumn(); ImGui::Text("%.1f", p95);
+            ImGui::TableNextColumn(); ImGui::Text("%.1f", p99);
+        }
+        ImGui::EndTable();
+    }
+    ImGui::Text("shown %llu  dropped %llu  repeated %llu  camera gaps %llu",
+                (unsigned long long) stats->displayed, (unsigned long long) stats->dropped,
+                (unsigned long long) stats->duplicated, (unsigned long long) stats->camera_gaps);
+    ImGui::End();
+}
 
 bool UIWindow::renderStartup() {
 
@@ -337,6 +493,12 @@ void UIWindow::renderSettingsWindow() {
                 formats = camera->getAvailFormatNames(camera_index, &formats_size);
             }
 
+            bool automatic_format = format_index < 0;
+            if (ImGui::Checkbox("Automatic Format", &automatic_format)) {
+                // picks the best probed format, see kbooth --probe-formats
+                format_index = automatic_format ? -1 : 0;
+                camera->open(camera_index, format_index);
+            }
             bool old_format_index = format_index;
             change = ImGui::Combo("Webcam Format", &format_index, formats, formats_size);
             if (change && old_format_index != format_index) {
@@ -394,6 +556,13 @@ void UIWindow::renderSettingsWindow() {
             if (ImGui::SliderFloat("Countdown Speed", &pace, 0.8, 3.0, "%.1fsec")) {
                 settings->countdown.pace = (int) (pace * 1000);
             }
+            ImGui::SliderInt("Burst Shots", &settings->countdown.burst_shots, 1, 4, "%d");
+            ImGui::BeginDisabled(settings->countdown.burst_shots < 2);
+            float interval = settings->countdown.burst_interval / 1000.0;
+            if (ImGui::SliderFloat("Burst Interval", &interval, 0.3, 3.0, "%.1fsec")) {
+                settings->countdown.burst_interval = (int) (interval * 1000);
+            }
+            ImGui::EndDisabled();
 
             fontSelector();
             ImGui::EndDisabled();
@@ -407,9 +576,22 @@ void UIWindow::renderSettingsWindow() {
 
             if (ImGui::RadioButton("Landscape", settings->print_settings.landscape)) { settings->print_settings.landscape = true; } ImGui::SameLine();
             if (ImGui::RadioButton("Portrait", !settings->print_settings.landscape)) { settings->print_settings.landscape = false; }
+            ImGui::Checkbox("Banded Printing", &settings->print_settings.banded);
 
             ImGui::SliderFloat("Image Brightness", &settings->print_settings.brightness, -250.0f, 250.0f, "%.1f");
             ImGui::SliderFloat("Image Contrast", &settings->print_settings.contrast, 0.0f, 2.5f, "%.2f");
+            ImGui::SliderFloat("Image Gamma", &settings->print_settings.gamma, 0.3f, 3.0f, "%.2f");
+            ImGui::DragIntRange2("Image Levels", &settings->print_settings.black_level,
+                                 &settings->print_settings.white_level, 1.0f, 0, 255);
+            const char *auto_tone_modes[] = {"Off", "Stretch", "Local (CLAHE)"};
+            int auto_tone = (int) settings->print_settings.auto_tone;
+            if (ImGui::Combo("Auto Tone", &auto_tone, auto_tone_modes, IM_ARRAYSIZE(auto_tone_modes))) {
+                settings->print_settings.auto_tone = (AutoToneMode) auto_tone;
+            }
+            ImGui::SliderInt("Sharpen Amount", &settings->print_settings.sharpen_amount, 0, UnsharpMask::MAX_AMOUNT, "%d%%");
+            ImGui::SliderInt("Sharpen Radius", &settings->print_settings.sharpen_radius, 1, UnsharpMask::MAX_RADIUS);
+            ImGui::SliderInt("Sharpen Threshold", &settings->print_settings.sharpen_threshold, 0, 32);
+            layoutSelector();
             if (settings->print_settings.print_images) ImGui::EndDisabled();
 
             ImGui::EndTabItem();
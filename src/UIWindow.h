@@ -7,6 +7,7 @@
 #include <vector>
 #include "Kbooth.h"
 #include "Camera.h"
+#include "PrintWorker.h"
 #include "SimpleIni.h"
 
 using namespace Kbooth;
@@ -28,11 +29,13 @@ class UIWindow {
         SDL_Renderer *renderer;
         SDL_Window *window;
         Camera *camera;
+        PrintWorker *print_worker;
         ImFont *font_regular;
         ImFont *font_countdown;
         bool ui_visible; // show/hide entire ui
         bool settings_button_visible;
         bool settings_opened; // show/hide settings
+        bool stats_visible; // show/hide camera pipeline latencies
         float alpha;
 
         // Settings
@@ -54,16 +57,27 @@ class UIWindow {
 
         bool *countdown_status;
 
+        // print status as drawn in the last frame
+        PrintJobStatus shown_status;
+        bool print_status_shown;
+
         // Methods
         void setStyleOptions();
         void renderSettingsWindow();
         void fontSelector();
+        void layoutSelector();
+        void renderPrintStatus();
+        void renderFrameStats();
+        void renderCameraStatus();
+        bool printStatusVisible(const PrintJobStatus &status);
     public:
         UIWindow(SDL_Window *window, SDL_Renderer *renderer, Settings *settings,
-                 Camera *camera, std::vector<UsbDevice> *usb_devices);
+                 Camera *camera, PrintWorker *print_worker, std::vector<UsbDevice> *usb_devices);
         ~UIWindow();
         void processEvent(SDL_Event *event);
         void render();
+        // whether the ui changes without an input event, e.g. a print status update
+        bool needsRedraw();
         bool renderStartup();
         void renderGlobalButtons();
         bool openSelectedPrinterUsbDevice(Printer *printer, CSimpleIniA *ini);
@@ -0,0 +1,178 @@
+#include "UnsharpMask.h"
+#include "Simd.h"
+
+#include <string.h>
+#include <vector>
+
+using namespace Kbooth;
+
+// sums of a 2 * radius + 1 box are divided as (sum + d / 2) * inverse >> 16, which stays below 256
+static inline uint32_t boxInverse(int d) {
+    return (uint32_t) ((65536 + d - 1) / d);
+}
+
+// horizontal box, edges repeated. A running sum along a row is one long dependency chain, so the
+// vector paths add up the 2 * radius + 1 shifted loads of an edge padded copy of the row instead
+static void blurRows(const uint8_t *src, int src_stride, uint8_t *dst, int w, int h, int radius, uint8_t *padded) {
+    int d = 2 * radius + 1, half = d / 2;
+    uint32_t inverse = boxInverse(d);
+#if defined(KB_SIMD_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half_v = _mm_set1_epi16((short) half);
+    const __m128i inverse_v = _mm_set1_epi16((short) inverse);
+#elif defined(KB_SIMD_NEON)
+    const uint16x8_t half_v = vdupq_n_u16((uint16_t) half);
+    const uint16x4_t inverse_v = vdup_n_u16((uint16_t) inverse);
+#endif
+    for (int y = 0; y < h; y++) {
+        const uint8_t *row = src + (size_t) y * src_stride;
+        uint8_t *out = dst + (size_t) y * w;
+        int x = 0;
+#if defined(KB_SIMD_SSE2) || defined(KB_SIMD_NEON)
+        memset(padded, row[0], radius);
+        memcpy(padded + radius, row, w);
+        memset(padded + radius + w, row[w - 1], radius);
+        for (; x + 8 <= w; x += 8) {
+            const uint8_t *window = padded + x;
+#if defined(KB_SIMD_SSE2)
+            __m128i sum = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) window), zero);
+            for (int k = 1; k < d; k++) {
+                sum = _mm_add_epi16(sum, _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (window + k)), zero));
+            }
+            __m128i value = _mm_mulhi_epu16(_mm_add_epi16(sum, half_v), inverse_v);
+            _mm_storel_epi64((__m128i *) (out + x), _mm_packus_epi16(value, value));
+#else
+            uint16x8_t sum = vaddl_u8(vld1_u8(window), vld1_u8(window + 1));
+            for (int k = 2; k < d; k++) sum = vaddw_u8(sum, vld1_u8(window + k));
+            uint16x8_t rounded = vaddq_u16(sum, half_v);
+            uint16x4_t low = vshrn_n_u32(vmull_u16(vget_low_u16(rounded), inverse_v), 16);
+            uint16x4_t high = vshrn_n_u32(vmull_u16(vget_high_u16(rounded), inverse_v), 16);
+            vst1_u8(out + x, vmovn_u16(vcombine_u16(low, high)));
+#endif
+        }
+#endif
+        if (x >= w) continue;
+        uint32_t sum = 0;
+        for (int i = x - radius; i <= x + radius; i++) sum += row[i < 0 ? 0 : i < w ? i : w - 1];
+        for (; x < w; x++) {
+            out[x] = (uint8_t) (((sum + half) * inverse) >> 16);
+            int add = x + radius + 1, sub = x - radius;
+            sum += row[add < w ? add : w - 1];
+            sum -= row[sub > 0 ? sub : 0];
+        }
+    }
+}
+
+// vertical box on a tight buffer, one running sum per column, so whole rows are updated at once
+static void blurColumns(const uint8_t *src, uint8_t *dst, int w, int h, int radius, uint16_t *sums) {
+    int d = 2 * radius + 1, half = d / 2;
+    uint32_t inverse = boxInverse(d);
+    for (int x = 0; x < w; x++) {
+        uint32_t sum = src[x] * (radius + 1);
+        for (int i = 1; i <= radius; i++) sum += src[(size_t) (i < h ? i : h - 1) * w + x];
+        sums[x] = (uint16_t) sum;
+    }
+#if defined(KB_SIMD_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half_v = _mm_set1_epi16((short) half);
+    const __m128i inverse_v = _mm_set1_epi16((short) inverse);
+#elif defined(KB_SIMD_NEON)
+    const uint16x8_t half_v = vdupq_n_u16((uint16_t) half);
+    const uint16x4_t inverse_v = vdup_n_u16((uint16_t) inverse);
+#endif
+    for (int y = 0; y < h; y++) {
+        int add_y = y + radius + 1, sub_y = y - radius;
+        const uint8_t *add = src + (size_t) (add_y < h ? add_y : h - 1) * w;
+        const uint8_t *sub = src + (size_t) (sub_y > 0 ? sub_y : 0) * w;
+        uint8_t *out = dst + (size_t) y * w;
+        int x = 0;
+#if defined(KB_SIMD_SSE2)
+        for (; x + 8 <= w; x += 8) {
+            __m128i sum = _mm_loadu_si128((const __m128i *) (sums + x));
+            __m128i value = _mm_mulhi_epu16(_mm_add_epi16(sum, half_v), inverse_v);
+            _mm_storel_epi64((__m128i *) (out + x), _mm_packus_epi16(value, value));
+            __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (add + x)), zero);
+            __m128i s = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (sub + x)), zero);
+            _mm_storeu_si128((__m128i *) (sums + x), _mm_sub_epi16(_mm_add_epi16(sum, a), s));
+        }
+#elif defined(KB_SIMD_NEON)
+        for (; x + 8 <= w; x += 8) {
+            uint16x8_t sum = vld1q_u16(sums + x);
+            uint16x8_t rounded = vaddq_u16(sum, half_v);
+            uint16x4_t low = vshrn_n_u32(vmull_u16(vget_low_u16(rounded), inverse_v), 16);
+            uint16x4_t high = vshrn_n_u32(vmull_u16(vget_high_u16(rounded), inverse_v), 16);
+            vst1_u8(out + x, vmovn_u16(vcombine_u16(low, high)));
+            vst1q_u16(sums + x, vsubw_u8(vaddw_u8(sum, vld1_u8(add + x)), vld1_u8(sub + x)));
+        }
+#endif
+        for (; x < w; x++) {
+            out[x] = (uint8_t) (((sums[x] + half) * inverse) >> 16);
+            sums[x] = (uint16_t) (sums[x] + add[x] - sub[x]);
+        }
+    }
+}
+
+void UnsharpMask::blur(const uint8_t *src, int src_stride, uint8_t *dst, int w, int h, int radius) {
+    if (radius < 1) radius = 1;
+    if (radius > MAX_RADIUS) radius = MAX_RADIUS;
+    std::vector<uint8_t> tmp((size_t) w * h);
+    std::vector<uint16_t> sums(w);
+    std::vector<uint8_t> padded(w + 2 * radius);
+    blurRows(src, src_stride, tmp.data(), w, h, radius, padded.data());
+    blurColumns(tmp.data(), dst, w, h, radius, sums.data());
+    blurRows(dst, w, tmp.data(), w, h, radius, padded.data());
+    blurColumns(tmp.data(), dst, w, h, radius, sums.data());
+}
+
+void UnsharpMask::apply(uint8_t *gray, int w, int h, int stride, int radius, int amount, int threshold) {
+    if (w <= 0 || h <= 0 || radius < 1 || amount <= 0) return;
+    if (amount > MAX_AMOUNT) amount = MAX_AMOUNT;
+    if (threshold < 0) threshold = 0;
+    if (threshold > 255) threshold = 255;
+    std::vector<uint8_t> blurred((size_t) w * h);
+    blur(gray, stride, blurred.data(), w, h, radius);
+
+    // amount in 1/32 steps: 255 * 400% fits a signed 16 bit lane
+    int scale = amount * 32 / 100;
+#if defined(KB_SIMD_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i scale_v = _mm_set1_epi16((short) scale);
+    const __m128i threshold_v = _mm_set1_epi16((short) threshold);
+    const __m128i round_v = _mm_set1_epi16(16);
+#elif defined(KB_SIMD_NEON)
+    const int16x8_t scale_v = vdupq_n_s16((int16_t) scale);
+    const int16x8_t threshold_v = vdupq_n_s16((int16_t) threshold);
+#endif
+    for (int y = 0; y < h; y++) {
+        uint8_t *row = gray + (size_t) y * stride;
+        const uint8_t *soft = blurred.data() + (size_t) y * w;
+        int x = 0;
+#if defined(KB_SIMD_SSE2)
+        for (; x + 8 <= w; x += 8) {
+            __m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (row + x)), zero);
+            __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (soft + x)), zero);
+            __m128i diff = _mm_sub_epi16(v, b);
+            __m128i edge = _mm_cmpgt_epi16(_mm_max_epi16(diff, _mm_sub_epi16(zero, diff)), threshold_v);
+            __m128i step = _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(diff, scale_v), round_v), 5);
+            v = _mm_add_epi16(v, _mm_and_si128(step, edge));
+            _mm_storel_epi64((__m128i *) (row + x), _mm_packus_epi16(v, v));
+        }
+#elif defined(KB_SIMD_NEON)
+        for (; x + 8 <= w; x += 8) {
+            int16x8_t v = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(row + x)));
+            int16x8_t b = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(soft + x)));
+            int16x8_t diff = vsubq_s16(v, b);
+            uint16x8_t edge = vcgtq_s16(vabsq_s16(diff), threshold_v);
+            int16x8_t step = vrshrq_n_s16(vmulq_s16(diff, scale_v), 5);
+            v = vaddq_s16(v, vandq_s16(step, vreinterpretq_s16_u16(edge)));
+            vst1_u8(row + x, vqmovun_s16(v));
+        }
+#endif
+        for (; x < w; x++) {
+            int diff = row[x] - soft[x];
+            if (diff <= threshold && diff >= -threshold) continue;
+            int value = row[x] + ((diff * scale + 16) >> 5);
+            row[x] = (uint8_t) (value < 0 ? 0 : value > 255 ? 255 : value);
+        }
+    }
+}
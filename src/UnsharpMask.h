@@ -0,0 +1,31 @@
+#ifndef KB_UNSHARP_MASK_H
+#define KB_UNSHARP_MASK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Kbooth {
+
+    /**
+     * Unsharp mask for the print-bound 8 bit gray image. Scaling a capture
+     * down to printer dots softens it and error diffusion smears what fine
+     * detail is left, so edges are pushed apart again right before
+     * dithering. The blur is two box passes, which is close enough to a
+     * gaussian; columns use running sums, rows shifted vector loads.
+     */
+    struct UnsharpMask {
+        static const int MAX_RADIUS = 8; // keeps the column sums in 16 bits
+        static const int MAX_AMOUNT = 400; // percent, keeps the scaled difference in 16 bits
+
+        // w x h bytes from src (rows src_stride apart) to the tight dst, blurred twice with a 2 * radius + 1 box
+        static void blur(const uint8_t *src, int src_stride, uint8_t *dst, int w, int h, int radius);
+        /**
+         * @brief Adds amount percent of the difference to the blur to every
+         * pixel where that difference is larger than threshold, so flat
+         * areas and sensor noise are left alone.
+         */
+        static void apply(uint8_t *gray, int w, int h, int stride, int radius, int amount, int threshold);
+    };
+}
+
+#endif // KB_UNSHARP_MASK_H
@@ -0,0 +1,222 @@
+#include "UsbTransport.h"
+
+#include <chrono>
+#include <iostream>
+
+using namespace Kbooth;
+
+UsbTransport::UsbTransport() :
+    ctx(nullptr),
+    handle(nullptr),
+    endpoint(0),
+    chunk_size(MAX_CHUNK_SIZE),
+    in_flight_count(0),
+    pending_offset(0),
+    bytes_queued(0),
+    bytes_done(0),
+    error(0),
+    running(false) {
+    for (int i = 0; i < TRANSFER_COUNT; i++) {
+        transfers[i] = nullptr;
+        in_flight[i] = false;
+    }
+}
+
+UsbTransport::~UsbTransport() {
+    stop();
+}
+
+bool UsbTransport::start(libusb_context *ctx, libusb_device_handle *handle, unsigned char endpoint) {
+    stop();
+    this->ctx = ctx;
+    this->handle = handle;
+    this->endpoint = endpoint;
+
+    int max_packet = libusb_get_max_packet_size(libusb_get_device(handle), endpoint);
+    if (max_packet <= 0) max_packet = 64;
+    chunk_size = (MAX_CHUNK_SIZE / max_packet) * max_packet;
+    if (chunk_size <= 0) chunk_size = max_packet;
+
+    for (int i = 0; i < TRANSFER_COUNT; i++) {
+        transfers[i] = libusb_alloc_transfer(0);
+        if (transfers[i] == nullptr) {
+            std::cerr << "ERROR: could not allocate usb transfer" << std::endl;
+            stop();
+            return false;
+        }
+        in_flight[i] = false;
+    }
+    reset();
+    running = true;
+    event_thread = std::thread(&UsbTransport::handleEvents, this);
+    std::cout << "USB transport: " << TRANSFER_COUNT << " transfers of " << chunk_size
+              << " bytes (max packet " << max_packet << ")" << std::endl;
+    return true;
+}
+
+void UsbTransport::stop() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        pending.clear();
+        drainInFlight(lock);
+        running = false;
+    }
+    if (event_thread.joinable()) event_thread.join();
+    for (int i = 0; i < TRANSFER_COUNT; i++) {
+        if (transfers[i] != nullptr) libusb_free_transfer(transfers[i]);
+        transfers[i] = nullptr;
+        in_flight[i] = false;
+    }
+    in_flight_count = 0;
+}
+
+void UsbTransport::drainInFlight(std::unique_lock<std::mutex> &lock) {
+    cancelInFlight();
+    // cancelled transfers still complete through the event thread, also when the device is gone
+    // (with LIBUSB_TRANSFER_NO_DEVICE); libusb still owns them until then, so they are never abandoned
+    while (event_thread.joinable() && in_flight_count > 0) {
+        if (cv.wait_for(lock, std::chrono::milliseconds((int) TRANSFER_TIMEOUT_MS),
+                        [this] { return in_flight_count == 0; })) break;
+        std::cerr << "ERROR: usb transfers still in flight, cancelling again" << std::endl;
+        cancelInFlight();
+    }
+}
+
+void UsbTransport::handleEvents() {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!running) return;
+        }
+        struct timeval tv = {0, 100000};
+        libusb_handle_events_timeout_completed(ctx, &tv, NULL);
+    }
+}
+
+uint64_t UsbTransport::write(const unsigned char *data, size_t length) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (error != 0 || !running) return 0;
+    // tickets are byte counts plus one, so 0 stays free for failures; nothing to send is done already
+    if (length == 0) return bytes_done + 1;
+    pending.push_back({.data = data, .length = length});
+    bytes_queued += length;
+    submitPending();
+    return bytes_queued + 1;
+}
+
+bool UsbTransport::wait(uint64_t ticket, unsigned int timeout_ms) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (ticket == 0) return false;
+    // a long raster on a slow printer may take much longer than timeout_ms as a whole,
+    // so the wait only gives up when nothing at all was sent for that long
+    bool finished = false;
+    while (!finished) {
+        uint64_t done_before = bytes_done;
+        bool woken = cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this, ticket, done_before] {
+            return error != 0 || bytes_done + 1 >= ticket || bytes_done != done_before;
+        });
+        if (!woken) break;
+        finished = error != 0 || bytes_done + 1 >= ticket;
+    }
+    if (finished && error == 0) return true;
+    if (!finished) {
+        std::cerr << "ERROR: usb transfer timed out, printer stalled?" << std::endl;
+        error = LIBUSB_TRANSFER_TIMED_OUT;
+    }
+    pending.clear();
+    cancelInFlight();
+    return false;
+}
+
+void UsbTransport::cancel() {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.clear();
+    cancelInFlight();
+}
+
+void UsbTransport::reset() {
+    std::unique_lock<std::mutex> lock(mutex);
+    pending.clear();
+    // the caller reuses the memory the transfers point into, and their late completions
+    // would count towards the next job, so nothing may be in flight past this point
+    drainInFlight(lock);
+    pending_offset = 0;
+    bytes_queued = bytes_done;
+    error = 0;
+}
+
+bool UsbTransport::failed() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return error != 0;
+}
+
+void UsbTransport::submitPending() {
+    for (int i = 0; i < TRANSFER_COUNT && !pending.empty(); i++) {
+        if (in_flight[i]) continue;
+        Segment &segment = pending.front();
+        size_t length = segment.length - pending_offset;
+        if (length > (size_t) chunk_size) length = chunk_size;
+
+        libusb_fill_bulk_transfer(transfers[i], handle, endpoint,
+                                  const_cast<unsigned char*>(segment.data + pending_offset),
+                                  (int) length, &UsbTransport::transferCallback, this,
+                                  TRANSFER_TIMEOUT_MS);
+        int err = libusb_submit_transfer(transfers[i]);
+        if (err != LIBUSB_SUCCESS) {
+            std::cerr << "ERROR: could not submit usb transfer: " << libusb_error_name(err) << std::endl;
+            error = LIBUSB_TRANSFER_ERROR;
+            pending.clear();
+            cancelInFlight();
+            cv.notify_all();
+            return;
+        }
+        in_flight[i] = true;
+        in_flight_count++;
+
+        pending_offset += length;
+        if (pending_offset == segment.length) {
+            pending.pop_front();
+            pending_offset = 0;
+        }
+    }
+}
+
+void UsbTransport::cancelInFlight() {
+    for (int i = 0; i < TRANSFER_COUNT; i++) {
+        if (in_flight[i]) libusb_cancel_transfer(transfers[i]);
+    }
+    pending_offset = 0;
+}
+
+void UsbTransport::transferCallback(libusb_transfer *transfer) {
+    static_cast<UsbTransport*>(transfer->user_data)->onTransferDone(transfer);
+}
+
+void UsbTransport::onTransferDone(libusb_transfer *transfer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int i = 0; i < TRANSFER_COUNT; i++) {
+        if (transfers[i] == transfer) in_flight[i] = false;
+    }
+    in_flight_count--;
+
+    if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
+        bytes_done += transfer->actual_length;
+        if (transfer->actual_length < transfer->length && error == 0) {
+            std::cerr << "ERROR: short usb write: " << transfer->actual_length << "/" << transfer->length << std::endl;
+            error = LIBUSB_TRANSFER_ERROR;
+        }
+    } else if (error == 0) {
+        if (transfer->status != LIBUSB_TRANSFER_CANCELLED) {
+            std::cerr << "ERROR: usb transfer failed with status " << (int) transfer->status << std::endl;
+        }
+        error = transfer->status;
+    }
+
+    if (error != 0) {
+        pending.clear();
+        cancelInFlight();
+    } else {
+        submitPending(); // keep the printer's receive buffer full
+    }
+    cv.notify_all();
+}
@@ -0,0 +1,81 @@
+#ifndef KB_USB_TRANSPORT_H
+#define KB_USB_TRANSPORT_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include "libusb.h"
+
+namespace Kbooth {
+
+    /**
+     * Asynchronous bulk OUT transport. Keeps several libusb transfers in
+     * flight so the printer's receive buffer never runs dry, and handles
+     * libusb events on its own thread.
+     *
+     * write() does not copy: the data must stay valid until wait() for the
+     * returned ticket has succeeded (or the transport has been cancelled).
+     */
+    class UsbTransport {
+    private:
+        static const int TRANSFER_COUNT = 4;
+        static const int MAX_CHUNK_SIZE = 16384;
+        static const unsigned int TRANSFER_TIMEOUT_MS = 5000;
+
+        struct Segment {
+            const unsigned char *data;
+            size_t length;
+        };
+
+        libusb_context *ctx;
+        libusb_device_handle *handle;
+        unsigned char endpoint;
+        int chunk_size; // multiple of the endpoint's max packet size
+
+        libusb_transfer *transfers[TRANSFER_COUNT];
+        bool in_flight[TRANSFER_COUNT];
+        int in_flight_count;
+
+        std::deque<Segment> pending;
+        size_t pending_offset; // bytes of pending.front() already submitted
+        uint64_t bytes_queued;
+        uint64_t bytes_done;
+        int error; // libusb_transfer_status of the first failed transfer, 0 if none
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::thread event_thread;
+        bool running;
+
+        static void transferCallback(libusb_transfer *transfer);
+        void onTransferDone(libusb_transfer *transfer);
+        void submitPending(); // mutex must be held
+        void cancelInFlight(); // mutex must be held
+        // cancels until no transfer is in flight anymore, lock must hold the mutex
+        void drainInFlight(std::unique_lock<std::mutex> &lock);
+        void handleEvents();
+    public:
+        UsbTransport();
+        ~UsbTransport();
+
+        bool start(libusb_context *ctx, libusb_device_handle *handle, unsigned char endpoint);
+        void stop();
+
+        // queues data and returns a ticket for wait(); 0 if the transport failed
+        uint64_t write(const unsigned char *data, size_t length);
+        // blocks until everything up to ticket has been sent; cancels on error or
+        // when no data at all could be sent for timeout_ms
+        bool wait(uint64_t ticket, unsigned int timeout_ms);
+        // drops pending data and cancels in-flight transfers
+        void cancel();
+        // clears a previous failure so the next job can be sent, returns once
+        // no transfer points into the data of the previous job anymore
+        void reset();
+        bool failed();
+    };
+}
+
+#endif // KB_USB_TRANSPORT_H
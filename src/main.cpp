@@ -2,9 +2,11 @@
 #include "SDL3/SDL_stdinc.h"
 #include "SimpleIni.h"
 #include "Camera.h"
+#include "FormatProbe.h"
 #include "Kbooth.h"
 #include "UIWindow.h"
 #include "Printer.h"
+#include "PrintWorker.h"
 
 #include <iostream>
 #include <string>
@@ -12,10 +14,11 @@
 using namespace Kbooth;
 
 void EXIT_WITH_ERROR(std::string error_message);
-void handle_user_input(UIWindow *ui, Camera *camera);
+bool handle_user_input(UIWindow *ui, Camera *camera);
 void handle_user_input(UIWindow *ui);
 void load_settings_config();
 void initializePrinter();
+void probe_camera_formats();
 
 int window_width;
 int window_height;
@@ -36,10 +39,17 @@ void LOG(std::string msg) {
     if (!logger) return;
 	std::cout << "[LOG] " << msg << std::endl;
 }
-int main() {
+int main(int argc, char *argv[]) {
+    bool probe_formats = argc > 1 && std::string(argv[1]) == "--probe-formats";
     LOG("STARTING >> KBOOTH <<");
 	load_settings_config();
     LOG("Loaded config");
+    if (probe_formats) {
+        if (!SDL_Init(SDL_INIT_CAMERA)) EXIT_WITH_ERROR("could not initialize SDL.");
+        probe_camera_formats();
+        SDL_Quit();
+        return EXIT_SUCCESS;
+    }
     initializePrinter();   
     LOG("Initialized Printer");
 
@@ -61,11 +71,14 @@ int main() {
     LOG("Initialized SDL");
     {
         Camera camera;
+        camera.setFormatSelection(&ini, &settings.format_target);
         if (!camera.open(0, settings.camera_format_index)) {
-        	EXIT_WITH_ERROR("Could not open Default Camera.");
+            // keeps showing the attract screen until a camera is connected
+        	LOG("Could not open Default Camera, waiting for one.");
         }
         camera.setAspectRatio(renderer, settings.framing.aspect_x, settings.framing.aspect_y);
-    	UIWindow ui = UIWindow(window, renderer, &settings, &camera, printer.getAvailUsbDevices());
+        PrintWorker print_worker(&printer); // joined before camera (and its logo) is destroyed
+    	UIWindow ui = UIWindow(window, renderer, &settings, &camera, &print_worker, printer.getAvailUsbDevices());
 
         if (settings.print_settings.print_images && !default_printer_configured) {
             UsbDevice *printer_dev = nullptr;
@@ -80,18 +93,32 @@ int main() {
         }
 
         LOG("STARTING RENDER LOOP");
+        const int UI_SETTLE_FRAMES = 3; // imgui needs a few frames to react to an input
+        const Sint32 IDLE_WAIT_MS = 100; // also bounds the delay of print status updates
+        int ui_frames = UI_SETTLE_FRAMES;
         while (!window_should_close) { // Main Loop
-            SDL_SetRenderDrawColorFloat(renderer, 0.0, 0.0, 0.0, 1.0);
-            SDL_RenderClear(renderer);
+            // only redraw when a camera frame, the countdown or the ui changed something
+            bool redraw = ui_frames > 0 || camera.needsRedraw() || ui.needsRedraw();
+            if (redraw) {
+                SDL_SetRenderDrawColorFloat(renderer, 0.0, 0.0, 0.0, 1.0);
+                SDL_RenderClear(renderer);
 
-            window_should_close = !camera.renderFrame(renderer, &settings);
+                window_should_close = !camera.renderFrame(renderer, &settings);
+            }
 			if (camera.updateCountdown(&settings.countdown)) {
-                camera.saveAndPrintImage(&printer, &settings.print_settings);
+                camera.saveAndPrintImage(&print_worker, &settings.print_settings);
+                ui_frames = UI_SETTLE_FRAMES; // show the capture button again
             }
-			ui.render();
-
-            SDL_RenderPresent(renderer);
-			handle_user_input(&ui, &camera);
+            if (redraw) {
+                ui.render();
+                SDL_RenderPresent(renderer);
+                camera.getFrameStats()->framePresented(SDL_GetTicksNS());
+                if (ui_frames > 0) ui_frames--;
+            } else {
+                // sleeps until an input event or the capture thread's frame event
+                SDL_WaitEventTimeout(NULL, IDLE_WAIT_MS);
+            }
+			if (handle_user_input(&ui, &camera)) ui_frames = UI_SETTLE_FRAMES;
         }
     }
     SDL_DestroyRenderer(renderer);
@@ -117,6 +144,8 @@ void load_settings_config() {
 		.countdown =  {
 			.len = 3,
 			.pace = 1500,
+			.burst_shots = 1,
+			.burst_interval = 1200,
 		},
         .print_settings = {
 		    .save_folder = "images",
@@ -125,11 +154,22 @@ void load_settings_config() {
             .usb_port = 7,
             .brightness = 100.0,
             .contrast = 0.40,
-            .landscape = false
+            .gamma = 1.0,
+            .black_level = 0,
+            .white_level = 255,
+            .auto_tone = AutoToneMode::Off,
+            .sharpen_amount = 0,
+            .sharpen_radius = 2,
+            .sharpen_threshold = 4,
+            .layout = "classic",
+            .landscape = false,
+            .banded = true,
+            .band_height = 128
         },
 		.capture_button = SDLK_SPACE, 
         .optimize_rasp_pi = true,
         .camera_format_index = 0,
+        .format_target = {.fps = 24, .width = 1280, .height = 720},
 	};
 	int err = ini.LoadFile("../assets/settings/config.ini"); 
     if (err < 0) {
@@ -157,10 +197,25 @@ void load_settings_config() {
 		settings.print_settings.save_images = ini.GetBoolValue("config", "SaveImages", true, NULL);
 		settings.print_settings.print_images = ini.GetBoolValue("config", "PrintImages", true, NULL);
 		settings.print_settings.usb_port = (int) ini.GetLongValue("config", "PrinterUsbPort", 7);
+		settings.print_settings.banded = ini.GetBoolValue("config", "BandedPrinting", true, NULL);
+		settings.print_settings.band_height = (int) ini.GetLongValue("config", "PrintBandHeight", 128);
+        std::string auto_tone = ini.GetValue("config", "AutoTone", "off");
+        if (auto_tone == "stretch") settings.print_settings.auto_tone = AutoToneMode::Stretch;
+        else if (auto_tone == "clahe") settings.print_settings.auto_tone = AutoToneMode::Clahe;
+        else settings.print_settings.auto_tone = AutoToneMode::Off;
+        settings.print_settings.sharpen_amount = (int) ini.GetLongValue("config", "SharpenAmount", 0);
+        settings.print_settings.sharpen_radius = (int) ini.GetLongValue("config", "SharpenRadius", 2);
+        settings.print_settings.sharpen_threshold = (int) ini.GetLongValue("config", "SharpenThreshold", 4);
+        settings.print_settings.layout = ini.GetValue("config", "PrintLayout", "classic");
 		settings.countdown.len = (int) ini.GetLongValue("config", "CountdownLen", 3);
 		settings.countdown.pace = (int) ini.GetLongValue("config", "CountdownPace", 1500);
+		settings.countdown.burst_shots = (int) ini.GetLongValue("config", "BurstShots", 1);
+		settings.countdown.burst_interval = (int) ini.GetLongValue("config", "BurstInterval", 1200);
         settings.optimize_rasp_pi = (bool) ini.GetBoolValue("config", "OptimizeRaspPI", true, NULL);
         settings.camera_format_index = (int) ini.GetLongValue("config", "CameraFormatIndex", 0);
+        settings.format_target.fps = (int) ini.GetLongValue("config", "CameraTargetFps", 24);
+        settings.format_target.width = (int) ini.GetLongValue("config", "CameraTargetWidth", 1280);
+        settings.format_target.height = (int) ini.GetLongValue("config", "CameraTargetHeight", 720);
 
 	}
 	bool created_output_folder_dir = createDirectory(settings.print_settings.save_folder.c_str());
@@ -181,19 +236,24 @@ void handle_user_input(UIWindow *ui) {
     }
 }
 
-void handle_user_input(UIWindow *ui, Camera *camera) {
+// returns whether an event other than a new camera frame was handled
+bool handle_user_input(UIWindow *ui, Camera *camera) {
 	SDL_Event event;
+	bool handled = false;
 	while (SDL_PollEvent(&event)) {
+		if (camera != nullptr && event.type == camera->getFrameEventType()) continue; // picked up by needsRedraw
+		handled = true;
 		if ((event.type == SDL_EVENT_QUIT) ||
 			(event.type == SDL_EVENT_WINDOW_CLOSE_REQUESTED &&
 			event.window.windowID == SDL_GetWindowID(window))) {
 			window_should_close = true;
 			break;
 		}
+		if (camera != nullptr) camera->handleEvent(&event); // before the ui reads the camera list
 		ui->processEvent(&event);
+		if (camera != nullptr && event.type == SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED) camera->invalidateLayout();
 
-
-		if (event.type != SDL_EVENT_KEY_DOWN) break;
+		if (event.type != SDL_EVENT_KEY_DOWN) continue;
 		// Toggle Fullscreen
 		if (event.key.key == SDLK_F) {
 			fullscreen = !fullscreen;
@@ -206,6 +266,29 @@ void handle_user_input(UIWindow *ui, Camera *camera) {
 			window_should_close = true;
 		}	
 	}
+	return handled;
+}
+
+// kbooth --probe-formats: measures every format of every camera and stores the ranking
+void probe_camera_formats() {
+    const Uint32 PROBE_DURATION_MS = 2000;
+    int count;
+    SDL_CameraID *camera_ids = SDL_GetCameras(&count);
+    if (camera_ids == nullptr || count == 0) {
+        std::cout << "No available Cameras" << std::endl;
+        SDL_free(camera_ids);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        const char *name = SDL_GetCameraName(camera_ids[i]);
+        LOG(std::string("Probing camera: ") + (name != nullptr ? name : "unknown"));
+        std::vector<FormatProbeResult> results = FormatProbe::run(camera_ids[i], PROBE_DURATION_MS);
+        FormatProbe::rank(&results, &settings.format_target);
+        FormatProbe::save(&ini, name, results);
+        if (!results.empty()) LOG("Best format: " + results[0].key);
+    }
+    SDL_free(camera_ids);
+    ini.SaveFile("../assets/settings/config.ini");
 }
 
 void initializePrinter() {